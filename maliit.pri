@@ -0,0 +1,29 @@
+# Sources shared by the plugin and the tests, which build them in
+QT += dbus gui-private
+INCLUDEPATH += $$PWD
+
+SOURCES += $$PWD/qmaliitplatforminputcontext.cpp \
+           $$PWD/qmattributeextensions.cpp \
+           $$PWD/qmcontextadaptor.cpp \
+           $$PWD/qmserverdbusaddress.cpp \
+           $$PWD/qmserverproxy.cpp \
+           $$PWD/qmsessionrecorder.cpp \
+           $$PWD/qmsharedbuffer.cpp \
+           $$PWD/qmstatistics.cpp
+
+HEADERS += $$PWD/qmaliitplatforminputcontext.h \
+           $$PWD/qmattributeextensions.h \
+           $$PWD/qmcontextadaptor.h \
+           $$PWD/qmnamespace.h \
+           $$PWD/qmserverdbusaddress.h \
+           $$PWD/qmserverproxy.h \
+           $$PWD/qmsessionrecorder.h \
+           $$PWD/qmsharedbuffer.h \
+           $$PWD/qmstatistics.h \
+           $$PWD/qmtrace.h
+
+# Trace events for system wide traces, see qmtrace.h
+maliit_tracing {
+    DEFINES += MALIIT_TRACING
+    SOURCES += $$PWD/qmtrace.cpp
+}
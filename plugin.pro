@@ -0,0 +1,10 @@
+TARGET = maliitplatforminputcontextplugin
+
+PLUGIN_TYPE = platforminputcontexts
+PLUGIN_CLASS_NAME = QMaliitPlatformInputContextPlugin
+load(qt_plugin)
+
+include($$PWD/maliit.pri)
+SOURCES += $$PWD/main.cpp
+
+OTHER_FILES += $$PWD/maliit.json
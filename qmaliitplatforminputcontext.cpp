@@ -18,9 +18,14 @@
 
 #include "qmaliitplatforminputcontext.h"
 
+#include "qmattributeextensions.h"
 #include "qmcontextadaptor.h"
 #include "qmserverdbusaddress.h"
 #include "qmserverproxy.h"
+#include "qmsessionrecorder.h"
+#include "qmsharedbuffer.h"
+#include "qmstatistics.h"
+#include "qmtrace.h"
 
 #include <QGuiApplication>
 #include <QScreen>
@@ -32,11 +37,25 @@
 #include <QLocale>
 #include <QWindow>
 #include <QSharedDataPointer>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QThread>
+#include <QTransform>
 
 namespace
 {
-    const int SoftwareInputPanelHideTimer = 100;
-    const char * const InputContextName = "MInputContext";
+    const int SoftwareInputPanelHideTimer = 100; // ms a show can still cancel a hide, e.g. moving to the next field
+    const int MaxUpdateLatency = 16; // ms, roughly one frame
+    const quint32 SharedBufferThreshold = 4096; // bytes, smaller payloads are sent inline
+    const char * const ConnectionName = "MaliitIMProxy";
+    const int MinReconnectDelay = 50; // ms, doubled after every failed attempt
+    const int MaxReconnectDelay = 10000;
+    const int MaxInitialConnectAttempts = 8; // without ever reaching the server, then only the service watcher retries
+    const qint64 MaxKeyResponseTime = 1000000000; // ns, forwarded keys without a response by then are forgotten
+    const int OrientationSettleTime = 100; // ms without further changes before the server relayouts for good
+    const int UnknownOrientation = -1;
+    const int KeyboardAnimationFrameTime = 50; // ms, keyboard rectangles closer together than this are animation frames
+    const int KeyboardSettleTime = 100; // ms without keyboard rectangle updates before an animation counts as done
 
     int orientationAngle(Qt::ScreenOrientation orientation)
     {
@@ -61,12 +80,53 @@ namespace
     enum InputPanelState {
         InputPanelShowPending,   // input panel showing requested, but activation pending
         InputPanelShown,
+        InputPanelHidePending,   // input panel hiding requested, the server hides it unless shown again soon
         InputPanelHidden
     };
+
+    // Formats for each Maliit::PreeditFace, built once and shared by all events
+    const QTextCharFormat &preeditFormat(Maliit::PreeditFace face)
+    {
+        static const QVector<QTextCharFormat> formats = [] {
+            QVector<QTextCharFormat> formats(Maliit::PreeditActive + 1);
+
+            formats[Maliit::PreeditDefault].setUnderlineStyle(QTextCharFormat::SingleUnderline);
+            formats[Maliit::PreeditDefault].setUnderlineColor(QColor(0, 0, 0));
+            formats[Maliit::PreeditKeyPress] = formats[Maliit::PreeditDefault];
+
+            formats[Maliit::PreeditNoCandidates].setUnderlineStyle(QTextCharFormat::SingleUnderline);
+            formats[Maliit::PreeditNoCandidates].setUnderlineColor(QColor(255, 0, 0));
+
+            formats[Maliit::PreeditUnconvertible].setForeground(QBrush(QColor(128, 128, 128)));
+
+            formats[Maliit::PreeditActive].setForeground(QBrush(QColor(153, 50, 204)));
+            formats[Maliit::PreeditActive].setFontWeight(QFont::Bold);
+
+            return formats;
+        }();
+        static const QTextCharFormat unknownFormat;
+
+        if (face < 0 || face >= formats.size())
+            return unknownFormat;
+        return formats.at(face);
+    }
+
+    enum ConnectionState {
+        ConnectionIdle,          // nothing needed the server yet
+        ConnectionPending,       // connecting in the background
+        ConnectionEstablished,
+        ConnectionFailed,        // retried after reconnectDelay
+        ConnectionUnavailable    // never reached, retried once org.maliit.server appears
+    };
 }
 
 static QString maliitServerAddress()
 {
+    // Allows running against a local stand-in server
+    const QString overridden = qEnvironmentVariable("MALIIT_SERVER_ADDRESS");
+    if (!overridden.isEmpty())
+        return overridden;
+
     org::maliit::Server::Address serverAddress(QStringLiteral("org.maliit.server"), QStringLiteral("/org/maliit/server/address"), QDBusConnection::sessionBus());
 
     QString address(serverAddress.address());
@@ -104,25 +164,100 @@ public:
     QMaliitPlatformInputContextPrivate(QMaliitPlatformInputContext *qq);
     ~QMaliitPlatformInputContextPrivate()
     {
-        delete adaptor;
+        ioThread.quit();
+        ioThread.wait();
+        // The connection is looked up by name, another context must not
+        // pick up this one's
+        if (connectionState == ConnectionEstablished) {
+            connection.unregisterObject("/com/meego/inputmethod/inputcontext");
+            QDBusConnection::disconnectFromPeer(QLatin1String(ConnectionName));
+        }
+        delete contextObject;
         delete server;
+        delete sharedBuffer;
     }
 
-    void sendStateUpdate(bool focusChanged = false);
+    void sendStateUpdate(bool focusChanged = false, bool fullSnapshot = false);
+    void flushPendingUpdate();
+    void updateSurroundingTextWindow(int cursorPosition, const QVariant &anchorPosition);
+    void connectToServer();
+    void connectionFinished(const QDBusConnection &newConnection);
+    void scheduleReconnect();
+    bool isConnected() const { return connectionState == ConnectionEstablished; }
+    void activateContext();
+    void hideInputPanel();
+    void orientationChanged(Qt::ScreenOrientation orientation);
+    void updateCursorRectangle(const QRect &rect);
+    void saveWindowState();
+    bool restoreWindowState();
+    void sendOrientation();
+    void replayState();
+    void offerSharedBuffer();
+    void negotiateDeltaUpdates();
+    void sendKeyEvent(const Maliit::KeyEventRecord &record);
+    void keyResponseArrived();
+    bool sendToFocusObject(QEvent *event);
+    bool resetPending() const { return acknowledgedResetSerial != resetSerial; }
+    QVariantMap withSharedPayloads(const QVariantMap &state);
 
     QDBusConnection connection;
-    ComMeegoInputmethodUiserver1Interface *server;
-    QMaliitInputcontext1Adaptor *adaptor;;
+    ConnectionState connectionState;
+    QTimer reconnectTimer;
+    int reconnectDelay;
+    int failedConnectAttempts; // since the last established connection
+    bool everConnected;
+    QDBusServiceWatcher *serverWatcher; // reconnects right away when the server comes back
+    QThread ioThread; // reads, demarshals and marshals D-Bus messages
+    ComMeegoInputmethodUiserver1Interface *server; // lives on ioThread
+    QMaliitInputcontext1Object *contextObject; // lives on ioThread
+    QMaliitInputcontext1Adaptor *adaptor;
+    QMaliitSessionReplayer *replayer; // stands in for the server when replaying a recorded session
+    QMaliitSharedBuffer *sharedBuffer;
+    bool sharedBufferAccepted; // payloads stay inline until the server accepted the buffer
+    quint32 resetSerial; // last reset() that waits for the server to catch up
+    quint32 acknowledgedResetSerial; // last reset() the server replied to
 
     InputPanelState inputPanelState; // state for the input method server's software input panel
+    QTimer hideTimer;
 
-    bool valid;
     bool active; // is connection active
     bool correctionEnabled;
     QRect keyboardRectangle;
+    QElapsedTimer keyboardRectangleSince; // time since the last keyboard rectangle change
+    QTimer keyboardSettleTimer;
+    bool keyboardAnimating;
     QString preedit;
+    QVector<Maliit::PreeditTextFormat> preeditFormats; // of the preedit last sent to the application
+    int preeditCursor;
+    bool preeditSynced; // false when preedit* no longer describe what the application shows
+    QList<QInputMethodEvent::Attribute> preeditAttributes;
     QPointer<QWindow> window;
+    int orientation; // angle of the window's content orientation
+    int announcedOrientation; // last appOrientationAboutToChange not yet followed by appOrientationChanged
+    int sentOrientation; // last appOrientationChanged
+    QTimer orientationTimer; // waits for the orientation to settle
+    QHash<QWindow *, QVariantMap> windowStates; // imState of windows that lost focus
+    QRect cursorRect; // as the focus object reported it
+    QTransform cursorTransform; // input item transform cursorRect was mapped with
+    QPointer<QWindow> cursorWindow; // null when nothing is cached
+    QPoint cursorWindowPosition;
+    QRect localCursorRect; // cursorRect in window coordinates
+    QRect globalCursorRect; // cursorRect in screen coordinates
+    bool redirectKeys; // hardware keys go to the server through processKeyEvent
+    QElapsedTimer keyLatencyClock;
+    QVector<qint64> forwardedKeys; // when redirected key presses were forwarded, oldest first
     QMap<QString, QVariant> imState;
+    QMap<QString, QVariant> serverState; // imState as last seen by the server
+    bool serverStateValid; // false forces the next update to be a full snapshot
+    bool deltaUpdatesAccepted; // full snapshots only until the server confirmed it merges deltas
+    Qt::InputMethodQueries pendingQueries; // queries merged until the next flush
+    QElapsedTimer pendingSince;
+    QTimer updateTimer;
+    int surroundingTextWindow; // characters on each side of the cursor, 0 sends the whole text
+    int surroundingTextOffset; // position of the sent text within the focus object's text
+    QMaliitAttributeExtensions attributeExtensions;
+    bool selectionCached; // selection holds the focus object's current selection
+    QVariant selection; // invalid when the focus object doesn't report one
 
     QMaliitPlatformInputContext *q;
 };
@@ -144,7 +279,9 @@ QMaliitPlatformInputContext::~QMaliitPlatformInputContext()
 
 bool QMaliitPlatformInputContext::isValid() const
 {
-    return d->valid;
+    // The connection is only made once something needs the server, so this
+    // can't wait for it. Report failure once it is known.
+    return d->connectionState != ConnectionFailed && d->connectionState != ConnectionUnavailable;
 }
 
 void QMaliitPlatformInputContext::setLanguage(const QString &)
@@ -154,25 +291,40 @@ void QMaliitPlatformInputContext::setLanguage(const QString &)
 
 void QMaliitPlatformInputContext::reset()
 {
-    if (debug) qDebug() << InputContextName << "in" << __PRETTY_FUNCTION__;
+    MALIIT_TRACE_SCOPE("reset");
+
+    d->flushPendingUpdate();
 
     const bool hadPreedit = !d->preedit.isEmpty();
     if (hadPreedit && inputMethodAccepted()) {
         // ### selection
         QInputMethodEvent event;
         event.setCommitString(d->preedit);
-        QGuiApplication::sendEvent(qGuiApp->focusObject(), &event);
+        d->sendToFocusObject(&event);
         d->preedit.clear();
     }
+    d->preeditSynced = false;
+
+    if (!d->isConnected())
+        return;
 
-    QDBusPendingReply<void> reply = d->server->reset();
-    if (hadPreedit)
-        reply.waitForFinished();
+    if (!hadPreedit) {
+        d->server->reset();
+        return;
+    }
+
+    // Preedit and commit messages the server sent before it handled the reset
+    // are stale. D-Bus keeps them in order with the reply, so rather than
+    // waiting for it, drop whatever arrives until the reply is in.
+    const quint32 serial = ++d->resetSerial;
+    d->server->reset(this, [this, serial](bool) {
+        d->acknowledgedResetSerial = serial;
+    });
 }
 
 void QMaliitPlatformInputContext::invokeAction(QInputMethod::Action action, int x)
 {
-    if (debug) qDebug() << InputContextName << "in" << __PRETTY_FUNCTION__;
+    MALIIT_TRACE_SCOPE("invokeAction");
 
     if (!inputMethodAccepted())
         return;
@@ -183,11 +335,13 @@ void QMaliitPlatformInputContext::invokeAction(QInputMethod::Action action, int
             return;
         }
 
+        d->flushPendingUpdate();
         d->imState["preeditClickPos"] = x;
         d->sendStateUpdate();
         // The first argument is the mouse pos and the second is the
         // preedit rectangle. Both are unused on the server side.
-        d->server->mouseClickedOnPreedit(0, 0, 0, 0, 0, 0);
+        if (d->isConnected())
+            d->server->mouseClickedOnPreedit(0, 0, 0, 0, 0, 0);
     } else {
         QPlatformInputContext::invokeAction(action, x);
     }
@@ -195,81 +349,71 @@ void QMaliitPlatformInputContext::invokeAction(QInputMethod::Action action, int
 
 void QMaliitPlatformInputContext::update(Qt::InputMethodQueries queries)
 {
-    if (debug) qDebug() << InputContextName << "in" << __PRETTY_FUNCTION__;
+    MALIIT_TRACE_SCOPE("update");
 
     if (!qGuiApp->focusObject())
         return;
 
-    QInputMethodQueryEvent query(queries);
-    QGuiApplication::sendEvent(qGuiApp->focusObject(), &query);
-
-    if (queries & Qt::ImSurroundingText)
-        d->imState["surroundingText"] = query.value(Qt::ImSurroundingText);
-    if (queries & Qt::ImCursorPosition)
-        d->imState["cursorPosition"] = query.value(Qt::ImCursorPosition);
-    if (queries & Qt::ImAnchorPosition)
-        d->imState["anchorPosition"] = query.value(Qt::ImAnchorPosition);
-    if (queries & Qt::ImCursorRectangle) {
-        QRect rect = query.value(Qt::ImCursorRectangle).toRect();
-        rect = qGuiApp->inputMethod()->inputItemTransform().mapRect(rect);
-        QWindow *window = qGuiApp->focusWindow();
-        if (window)
-            d->imState["cursorRectangle"] = QRect(window->mapToGlobal(rect.topLeft()), rect.size());
-    }
-
-    if (queries & Qt::ImCurrentSelection)
-        d->imState["hasSelection"] = !query.value(Qt::ImCurrentSelection).toString().isEmpty();
-
-    if (queries & Qt::ImHints) {
-        Qt::InputMethodHints hints = Qt::InputMethodHints(query.value(Qt::ImHints).toUInt());
-
-        d->imState["predictionEnabled"] = !(hints & Qt::ImhNoPredictiveText);
-        d->imState["autocapitalizationEnabled"] = !(hints & Qt::ImhNoAutoUppercase);
-        d->imState["hiddenText"] = (hints & Qt::ImhHiddenText) != 0;
-
-        d->imState["contentType"] = contentType(hints);
-    }
-
-    d->sendStateUpdate(/*focusChanged*/true);
+    // Qt reports cursor, anchor, selection and hint changes as separate updates.
+    // Merge them and query the focus object once per event loop iteration, but
+    // don't let a busy event loop hold the state back for longer than a frame.
+    if (!d->pendingQueries)
+        d->pendingSince.start();
+    d->pendingQueries |= queries;
+
+    if (d->pendingSince.elapsed() >= MaxUpdateLatency)
+        d->flushPendingUpdate();
+    else if (!d->updateTimer.isActive())
+        d->updateTimer.start();
 }
 
 void QMaliitPlatformInputContext::updateServerOrientation(Qt::ScreenOrientation orientation)
 {
-    d->server->appOrientationChanged(orientationAngle(orientation));
+    d->orientationChanged(orientation);
 }
 
 void QMaliitPlatformInputContext::setFocusObject(QObject *focused)
 {
-    if (debug) qDebug() << InputContextName << "in" << __PRETTY_FUNCTION__ << focused;
-
-    if (!d->valid)
-        return;
+    MALIIT_TRACE_SCOPE("setFocusObject");
 
     QWindow *window = qGuiApp->focusWindow();
+    bool restored = false;
     if (window != d->window.data()) {
-        if (d->window)
+        if (d->window) {
             disconnect(d->window.data(), SIGNAL(contentOrientationChanged(Qt::ScreenOrientation)),
                        this, SLOT(updateServerOrientation(Qt::ScreenOrientation)));
+            d->saveWindowState();
+        }
         d->window = window;
-        if (d->window)
+        if (d->window) {
             connect(d->window.data(), SIGNAL(contentOrientationChanged(Qt::ScreenOrientation)),
                     this, SLOT(updateServerOrientation(Qt::ScreenOrientation)));
+            restored = d->restoreWindowState();
+            d->orientation = orientationAngle(d->window->contentOrientation());
+            d->sendOrientation();
+        }
     }
 
+    d->preeditSynced = false;
+    d->selectionCached = false;
+    // The new focus object reports its own cursor rectangle
+    d->cursorWindow = nullptr;
     d->imState["focusState"] = (focused != 0);
     if (inputMethodAccepted()) {
-        if (window)
+        if (window && !restored)
             d->imState["winId"] = static_cast<qulonglong>(window->winId());
 
-        if (!d->active) {
-            d->active = true;
-            d->server->activateContext();
-
-            if (window)
-                d->server->appOrientationChanged(orientationAngle(window->contentOrientation()));
-        }
+        // First text focus, the state is replayed once connected
+        d->connectToServer();
     }
-    d->sendStateUpdate(/*focusChanged*/true);
+
+    if (!d->isConnected())
+        return;
+
+    if (inputMethodAccepted() && !d->active)
+        d->activateContext();
+    // The server only needs to hear what differs from the window it had before
+    d->sendStateUpdate(/*focusChanged*/true, /*fullSnapshot*/!restored);
     if (inputMethodAccepted() && window && d->inputPanelState == InputPanelShown)
         showInputPanel();
 
@@ -287,19 +431,30 @@ QRectF QMaliitPlatformInputContext::keyboardRect() const
 
 bool QMaliitPlatformInputContext::isAnimating() const
 {
-    return false; // don't know here when input method server is actually doing transitions
+    // The server doesn't tell, a stream of keyboard rectangles is taken as a transition
+    return d->keyboardAnimating;
 }
 
 void QMaliitPlatformInputContext::showInputPanel()
 {
-    if (debug) qDebug() << __PRETTY_FUNCTION__;
+    MALIIT_TRACE_SCOPE("showInputPanel");
 
     if (debug)
         qDebug() << "showInputPanel";
 
-    if (!inputMethodAccepted())
+    if (!inputMethodAccepted()) {
+        if (d->inputPanelState == InputPanelHidePending)
+            d->hideInputPanel();
         d->inputPanelState = InputPanelShowPending;
-    else {
+    } else if (!d->isConnected()) {
+        // Shown once the connection is up
+        d->inputPanelState = InputPanelShowPending;
+        d->connectToServer();
+    } else if (d->inputPanelState == InputPanelHidePending) {
+        // The server hasn't been told to hide it yet
+        d->hideTimer.stop();
+        d->inputPanelState = InputPanelShown;
+    } else {
         d->server->showInputMethod();
         d->inputPanelState = InputPanelShown;
         emitInputPanelVisibleChanged();
@@ -308,16 +463,20 @@ void QMaliitPlatformInputContext::showInputPanel()
 
 void QMaliitPlatformInputContext::hideInputPanel()
 {
-    if (debug) qDebug() << __PRETTY_FUNCTION__;
-
-    d->server->hideInputMethod();
-    d->inputPanelState = InputPanelHidden;
-    emitInputPanelVisibleChanged();
+    MALIIT_TRACE_SCOPE("hideInputPanel");
+
+    if (d->inputPanelState == InputPanelShown && d->isConnected()) {
+        // Keep it visible for a moment in case another field asks for it
+        d->inputPanelState = InputPanelHidePending;
+        d->hideTimer.start();
+    } else if (d->inputPanelState != InputPanelHidePending) {
+        d->hideInputPanel();
+    }
 }
 
 bool QMaliitPlatformInputContext::isInputPanelVisible() const
 {
-    return d->inputPanelState == InputPanelShown;
+    return d->inputPanelState == InputPanelShown || d->inputPanelState == InputPanelHidePending;
 }
 
 void QMaliitPlatformInputContext::activationLostEvent()
@@ -325,14 +484,61 @@ void QMaliitPlatformInputContext::activationLostEvent()
     // This method is called when activation was gracefully lost.
     // There is similar cleaning up done in onDBusDisconnection.
     d->active = false;
+    d->hideTimer.stop();
     d->inputPanelState = InputPanelHidden;
 }
 
+void QMaliitPlatformInputContext::onDBusDisconnection()
+{
+    // The connection may report its end more than once
+    if (!d->isConnected())
+        return;
+
+    qWarning() << "Maliit: lost connection to the input method server, reconnecting";
+
+    d->connection.unregisterObject("/com/meego/inputmethod/inputcontext");
+    QDBusConnection::disconnectFromPeer(QLatin1String(ConnectionName));
+    d->connection = QDBusConnection(QString());
+    d->connectionState = ConnectionFailed;
+    d->server->deleteLater(); // may still have queued calls on the D-Bus thread
+    d->server = nullptr;
+    d->sharedBufferAccepted = false;
+    d->deltaUpdatesAccepted = false;
+    d->active = false;
+    // Replies to pending resets will never arrive
+    d->acknowledgedResetSerial = d->resetSerial;
+
+    // The preedit went away with the server
+    d->preeditSynced = false;
+    if (!d->preedit.isEmpty()) {
+        d->preedit.clear();
+        if (inputMethodAccepted()) {
+            QInputMethodEvent event;
+            d->sendToFocusObject(&event);
+        }
+    }
+
+    // So does the input panel, show it again once reconnected
+    if (d->inputPanelState == InputPanelHidePending)
+        d->hideInputPanel();
+    if (d->inputPanelState == InputPanelShown) {
+        d->inputPanelState = InputPanelShowPending;
+        emitInputPanelVisibleChanged();
+    }
+    if (!d->keyboardRectangle.isNull()) {
+        d->keyboardRectangle = QRect();
+        emitKeyboardRectChanged();
+    }
+
+    d->scheduleReconnect();
+}
+
 
 void QMaliitPlatformInputContext::imInitiatedHide()
 {
-    if (debug) qDebug() << InputContextName << "in" << __PRETTY_FUNCTION__;
+    MALIIT_TRACE_SCOPE("imInitiatedHide");
 
+    d->hideTimer.stop();
     d->inputPanelState = InputPanelHidden;
     emitInputPanelVisibleChanged();
     // ### clear focus
@@ -342,90 +548,57 @@ void QMaliitPlatformInputContext::imInitiatedHide()
 void QMaliitPlatformInputContext::commitString(const QString &string, int replacementStart,
                                  int replacementLength, int  /*cursorPos*/)
 {
-    if (debug) qDebug() << InputContextName << "in" << __PRETTY_FUNCTION__;
+    MALIIT_TRACE_SCOPE("commitString");
 
-    if (!inputMethodAccepted())
+    if (!inputMethodAccepted() || d->resetPending())
         return;
 
+    d->keyResponseArrived();
     d->preedit.clear();
+    d->preeditSynced = false;
 
     if (debug)
         qWarning() << "CommitString" << string;
     // ### start/cursorPos
     QInputMethodEvent event;
     event.setCommitString(string, replacementStart, replacementLength);
-    QCoreApplication::sendEvent(qGuiApp->focusObject(), &event);
+    d->sendToFocusObject(&event);
 }
 
 
-void QMaliitPlatformInputContext::updatePreedit(const QDBusMessage &message)
+void QMaliitPlatformInputContext::updatePreedit(const QString &text, const QVector<Maliit::PreeditTextFormat> &formats,
+                                                int replacementStart, int replacementLength, int cursorPos)
 {
-    if (debug) {
-        qDebug() << InputContextName << "in" << __PRETTY_FUNCTION__ ;
-    }
+    MALIIT_TRACE_SCOPE("updatePreedit");
 
-    if (!inputMethodAccepted())
+    if (!inputMethodAccepted() || d->resetPending())
         return;
 
-    QList<QVariant> arguments = message.arguments();
-    if (arguments.count() != 5) {
-        qWarning() << "QMaliitPlatformInputContext::updatePreedit: Received message from input method server with wrong parameters.";
-        return;
-    }
+    d->keyResponseArrived();
 
-    d->preedit = arguments[0].toString();
-
-    QList<QInputMethodEvent::Attribute> attributes;
+    if (debug)
+        qWarning() << "updatePreedit" << text << replacementStart << replacementLength << cursorPos;
 
-    const QDBusArgument formats = arguments[1].value<QDBusArgument>();
-    formats.beginArray();
-    while (!formats.atEnd()) {
-        formats.beginStructure();
-        int start, length, preeditFace;
-        formats >> start >> length >> preeditFace;
-        formats.endStructure();
-
-        QTextCharFormat format;
-
-        enum PreeditFace {
-            PreeditDefault,
-            PreeditNoCandidates,
-            PreeditKeyPress,      //!< Used for displaying the hwkbd key just pressed
-            PreeditUnconvertible, //!< Inactive preedit region, not clickable
-            PreeditActive,        //!< Preedit region with active suggestions
-
-        };
-        switch (PreeditFace(preeditFace)) {
-        case PreeditDefault:
-        case PreeditKeyPress:
-            format.setUnderlineStyle(QTextCharFormat::SingleUnderline);
-            format.setUnderlineColor(QColor(0, 0, 0));
-            break;
-        case PreeditNoCandidates:
-            format.setUnderlineStyle(QTextCharFormat::SingleUnderline);
-            format.setUnderlineColor(QColor(255, 0, 0));
-            break;
-        case PreeditUnconvertible:
-            format.setForeground(QBrush(QColor(128, 128, 128)));
-            break;
-        case PreeditActive:
-            format.setForeground(QBrush(QColor(153, 50, 204)));
-            format.setFontWeight(QFont::Bold);
-            break;
-        default:
-            break;
-        }
+    // Predictive and CJK input repeat the same preedit a lot, don't make
+    // the application relayout for nothing.
+    if (d->preeditSynced && !replacementStart && !replacementLength
+            && text == d->preedit && cursorPos == d->preeditCursor && formats == d->preeditFormats)
+        return;
 
-        attributes << QInputMethodEvent::Attribute(QInputMethodEvent::TextFormat, start, length, format);
-    }
-    formats.endArray();
+    d->preedit = text;
+    d->preeditFormats = formats;
+    d->preeditCursor = cursorPos;
+    d->preeditSynced = true;
 
-    int replacementStart = arguments[2].toInt();
-    int replacementLength = arguments[3].toInt();
-    int cursorPos = arguments[4].toInt();
+    // Unlike clear(), erasing keeps the list's allocation for the next update
+    QList<QInputMethodEvent::Attribute> &attributes = d->preeditAttributes;
+    attributes.erase(attributes.begin(), attributes.end());
+    attributes.reserve(formats.size() + 1);
 
-    if (debug)
-        qWarning() << "updatePreedit" << d->preedit << replacementStart << replacementLength << cursorPos;
+    for (const Maliit::PreeditTextFormat &format : qAsConst(formats)) {
+        attributes << QInputMethodEvent::Attribute(QInputMethodEvent::TextFormat, format.start, format.length,
+                                                   preeditFormat(format.preeditFace));
+    }
 
     if (cursorPos >= 0)
         attributes << QInputMethodEvent::Attribute(QInputMethodEvent::Cursor, cursorPos, 1, QVariant());
@@ -433,39 +606,45 @@ void QMaliitPlatformInputContext::updatePreedit(const QDBusMessage &message)
     QInputMethodEvent event(d->preedit, attributes);
     if (replacementStart || replacementLength)
         event.setCommitString(QString(), replacementStart, replacementLength);
-    QCoreApplication::sendEvent(qGuiApp->focusObject(), &event);
+    d->sendToFocusObject(&event);
 
 }
 
 void QMaliitPlatformInputContext::keyEvent(int type, int key, int modifiers, const QString &text,
                              bool autoRepeat, int count, uchar requestType_)
 {
-    if (debug) qDebug() << InputContextName << "in" << __PRETTY_FUNCTION__;
+    MALIIT_TRACE_SCOPE("keyEvent");
 
-    Maliit::EventRequestType requestType = Maliit::EventRequestType(requestType_);
-    if (requestType == Maliit::EventRequestSignalOnly) {
-        qWarning() << "Maliit: Signal emitted key events are not supported.";
-        return;
-    }
+    if (d->window)
+        d->sendKeyEvent(Maliit::KeyEventRecord(type, key, modifiers, text, autoRepeat, count,
+                                               Maliit::EventRequestType(requestType_)));
+}
 
-    // HACK: This code relies on QEvent::Type for key events and modifiers to be binary compatible between
-    // Qt 4 and 5.
-    QEvent::Type eventType = static_cast<QEvent::Type>(type);
-    if (type != QEvent::KeyPress && type != QEvent::KeyRelease) {
-        qWarning() << "Maliit: Unknown key event type" << type;
-        return;
-    }
+void QMaliitPlatformInputContext::keyEvents(const QVector<Maliit::KeyEventRecord> &events)
+{
+    MALIIT_TRACE_SCOPE("keyEvents");
 
-    QKeyEvent event(eventType, key, static_cast<Qt::KeyboardModifiers>(modifiers),
-                    text, autoRepeat, count);
-    if (d->window)
-        QCoreApplication::sendEvent(d->window.data(), &event);
+    for (const Maliit::KeyEventRecord &event : events) {
+        // Handling one of the events may close the window
+        if (!d->window)
+            break;
+        d->sendKeyEvent(event);
+    }
 }
 
 bool QMaliitPlatformInputContext::preeditRectangle(int &x, int &y, int &width, int &height)
 {
-    // ###
-    QRect r = qApp->inputMethod()->cursorRectangle().toRect();
+    // Answer from the cached rectangle unless a newer one is waiting
+    if (d->pendingQueries & Qt::ImCursorRectangle)
+        d->flushPendingUpdate();
+
+    QRect r;
+    if (d->cursorWindow && d->cursorWindow.data() == qGuiApp->focusWindow()) {
+        d->updateCursorRectangle(d->cursorRect); // the item transform may have changed since
+        r = d->localCursorRect;
+    } else {
+        r = qApp->inputMethod()->cursorRectangle().toRect();
+    }
     if (!r.isValid())
         return false;
     x = r.x();
@@ -482,21 +661,43 @@ bool QMaliitPlatformInputContext::selection(QString &selection)
     if (!inputMethodAccepted())
         return false;
 
-    QInputMethodQueryEvent query(Qt::ImCurrentSelection);
-    QGuiApplication::sendEvent(qGuiApp->focusObject(), &query);
-    QVariant value = query.value(Qt::ImCurrentSelection);
-    if (!value.isValid())
+    // Selection changes that are still being coalesced invalidate the cache
+    if (d->pendingQueries)
+        d->flushPendingUpdate();
+
+    // Fetched the first time the server asks after a change, see
+    // flushPendingUpdate()
+    if (!d->selectionCached) {
+        QInputMethodQueryEvent query(Qt::ImCurrentSelection);
+        d->sendToFocusObject(&query);
+        d->selection = query.value(Qt::ImCurrentSelection);
+        d->selectionCached = true;
+    }
+    if (!d->selection.isValid())
         return false;
 
-    selection = value.toString();
+    selection = d->selection.toString();
     return true;
 }
 
 void QMaliitPlatformInputContext::updateInputMethodArea(int x, int y, int width, int height)
 {
+    const QRect rect(x, y, width, height);
+    if (rect == d->keyboardRectangle)
+        return;
+
     bool wasVisible = isInputPanelVisible();
 
-    d->keyboardRectangle = QRect(x, y, width, height);
+    const bool frame = d->keyboardRectangleSince.isValid()
+            && d->keyboardRectangleSince.elapsed() < KeyboardAnimationFrameTime;
+    d->keyboardRectangleSince.start();
+    d->keyboardSettleTimer.start();
+
+    d->keyboardRectangle = rect;
+    if (frame && !d->keyboardAnimating) {
+        d->keyboardAnimating = true;
+        emitAnimatingChanged();
+    }
     emitKeyboardRectChanged();
 
     if (wasVisible != isInputPanelVisible()) {
@@ -511,9 +712,17 @@ void QMaliitPlatformInputContext::setGlobalCorrectionEnabled(bool enabled)
     d->correctionEnabled = enabled;
 }
 
+void QMaliitPlatformInputContext::notifyExtendedAttributeChanged(int id, const QString &target, const QString &targetItem,
+                                                                 const QString &attribute, const QDBusVariant &value)
+{
+    MALIIT_TRACE_SCOPE("notifyExtendedAttributeChanged");
+    d->attributeExtensions.serverChanged(id, target, targetItem, attribute, value.variant());
+}
+
 void QMaliitPlatformInputContext::onInvokeAction(const QString &action, const QKeySequence &sequence)
 {
-    if (debug) qDebug() << InputContextName << __PRETTY_FUNCTION__ << "action" << action;
+    MALIIT_TRACE_SCOPE("onInvokeAction");
+    Q_UNUSED(action);
 
     // NOTE: currently not trying to trigger action directly
     static const Qt::KeyboardModifiers AllModifiers = Qt::ShiftModifier | Qt::ControlModifier | Qt::AltModifier
@@ -521,6 +730,8 @@ void QMaliitPlatformInputContext::onInvokeAction(const QString &action, const QK
 
     Maliit::EventRequestType requestType = Maliit::EventRequestType();
 
+    QVector<Maliit::KeyEventRecord> events;
+    events.reserve(sequence.count() * 2);
     for (int i = 0; i < sequence.count(); i++) {
         const int key = sequence[i] & ~AllModifiers;
         const int modifiers = sequence[i] & AllModifiers;
@@ -529,14 +740,37 @@ void QMaliitPlatformInputContext::onInvokeAction(const QString &action, const QK
             text = QString(key);
         }
 
-        keyEvent(QEvent::KeyPress, key, modifiers, text, false, 1, requestType);
-        keyEvent(QEvent::KeyRelease, key, modifiers, text, false, 1, requestType);
+        events << Maliit::KeyEventRecord(QEvent::KeyPress, key, modifiers, text, false, 1, requestType);
+        events << Maliit::KeyEventRecord(QEvent::KeyRelease, key, modifiers, text, false, 1, requestType);
     }
+    keyEvents(events);
 }
 
 void QMaliitPlatformInputContext::setRedirectKeys(bool enabled)
 {
-    Q_UNUSED(enabled)
+    d->redirectKeys = enabled;
+    if (!enabled)
+        d->forwardedKeys.clear();
+}
+
+bool QMaliitPlatformInputContext::filterEvent(const QEvent *event)
+{
+    if (event->type() != QEvent::KeyPress && event->type() != QEvent::KeyRelease)
+        return false;
+
+    if (!d->redirectKeys || !d->isConnected() || !inputMethodAccepted())
+        return false;
+
+    const QKeyEvent *keyEvent = static_cast<const QKeyEvent *>(event);
+    d->server->processKeyEvent(keyEvent->type(), keyEvent->key(), keyEvent->modifiers(), keyEvent->text(),
+                               keyEvent->isAutoRepeat(), keyEvent->count(), keyEvent->nativeScanCode(),
+                               keyEvent->nativeModifiers(), keyEvent->timestamp());
+
+    // Releases don't produce anything, only time the presses
+    if (keyEvent->type() == QEvent::KeyPress)
+        d->forwardedKeys.append(d->keyLatencyClock.nsecsElapsed());
+
+    return true;
 }
 
 void QMaliitPlatformInputContext::setDetectableAutoRepeat(bool enabled)
@@ -550,28 +784,76 @@ void QMaliitPlatformInputContext::setSelection(int start, int length)
     if (!inputMethodAccepted())
         return;
 
+    // The server only knows the surrounding text window
+    start += d->surroundingTextOffset;
+
     QList<QInputMethodEvent::Attribute> attributes;
     attributes << QInputMethodEvent::Attribute(QInputMethodEvent::Selection, start, length, QVariant());
     QInputMethodEvent event(QString(), attributes);
-    QGuiApplication::sendEvent(qGuiApp->focusObject(), &event);
+    d->sendToFocusObject(&event);
 }
 
 QMaliitPlatformInputContextPrivate::QMaliitPlatformInputContextPrivate(QMaliitPlatformInputContext* qq)
-    : connection(QDBusConnection::connectToPeer(maliitServerAddress(), QLatin1String("MaliitIMProxy")))
+    : connection(QString())
+    , connectionState(ConnectionIdle)
+    , reconnectDelay(MinReconnectDelay)
+    , failedConnectAttempts(0)
+    , everConnected(false)
+    , serverWatcher(nullptr)
     , server(nullptr)
+    , contextObject(nullptr)
     , adaptor(nullptr)
+    , replayer(QMaliitSessionReplayer::create(qq, QMaliitPlatformInputContext::debug))
+    , sharedBuffer(nullptr)
+    , sharedBufferAccepted(false)
+    , resetSerial(0)
+    , acknowledgedResetSerial(0)
     , inputPanelState(InputPanelHidden)
-    , valid(false)
     , active(false)
     , correctionEnabled(false)
+    , keyboardAnimating(false)
+    , preeditCursor(-1)
+    , preeditSynced(false)
+    , orientation(UnknownOrientation)
+    , announcedOrientation(UnknownOrientation)
+    , sentOrientation(UnknownOrientation)
+    , redirectKeys(false)
+    , serverStateValid(false)
+    , deltaUpdatesAccepted(false)
+    , surroundingTextWindow(qMax(0, qEnvironmentVariableIntValue("MALIIT_SURROUNDING_TEXT_WINDOW")))
+    , surroundingTextOffset(0)
+    , selectionCached(false)
     , q(qq)
 {
-    if (!connection.isConnected())
-        return;
+    keyboardSettleTimer.setSingleShot(true);
+    keyboardSettleTimer.setInterval(KeyboardSettleTime);
+    QObject::connect(&keyboardSettleTimer, &QTimer::timeout, qq, [this] {
+        if (!keyboardAnimating)
+            return;
+        // Whoever waited for the animation to end gets the final rectangle
+        keyboardAnimating = false;
+        q->emitAnimatingChanged();
+        q->emitKeyboardRectChanged();
+    });
 
-    server = new ComMeegoInputmethodUiserver1Interface(QString(""), QStringLiteral("/com/meego/inputmethod/uiserver1"), connection);
-    adaptor = new QMaliitInputcontext1Adaptor(qq);
-    connection.registerObject("/com/meego/inputmethod/inputcontext", qq);
+    hideTimer.setSingleShot(true);
+    hideTimer.setInterval(SoftwareInputPanelHideTimer);
+    QObject::connect(&hideTimer, &QTimer::timeout, qq, [this] { hideInputPanel(); });
+
+    updateTimer.setSingleShot(true);
+    updateTimer.setInterval(0);
+    QObject::connect(&updateTimer, &QTimer::timeout, qq, [this] { flushPendingUpdate(); });
+
+    orientationTimer.setSingleShot(true);
+    orientationTimer.setInterval(OrientationSettleTime);
+    QObject::connect(&orientationTimer, &QTimer::timeout, qq, [this] { sendOrientation(); });
+
+    keyLatencyClock.start();
+
+    ioThread.setObjectName(QStringLiteral("maliit-dbus"));
+
+    reconnectTimer.setSingleShot(true);
+    QObject::connect(&reconnectTimer, &QTimer::timeout, qq, [this] { connectToServer(); });
 
     enum InputMethodMode {
         //! Normal mode allows to use preedit and error correction
@@ -586,12 +868,501 @@ QMaliitPlatformInputContextPrivate::QMaliitPlatformInputContextPrivate(QMaliitPl
     imState["inputMethodMode"] = InputMethodModeNormal;
 
     imState["correctionEnabled"] = true;
+}
+
+void QMaliitPlatformInputContextPrivate::connectToServer()
+{
+    if (connectionState != ConnectionIdle && connectionState != ConnectionFailed)
+        return;
 
-    valid = true;
+    reconnectTimer.stop();
+    connectionState = ConnectionPending;
+
+    // Replays talk to the replayer's sink, so that outbound calls still
+    // cost what they do with a server
+    const QString sinkAddress = replayer ? replayer->sinkAddress() : QString();
+
+    // Both the address lookup on the session bus and connecting to the peer
+    // block, so they run on a short lived thread instead of the GUI thread.
+    QPointer<QMaliitPlatformInputContext> context(q);
+    QThread *thread = QThread::create([this, context, sinkAddress] {
+        const QString address = sinkAddress.isEmpty() ? maliitServerAddress() : sinkAddress;
+        const QDBusConnection newConnection = QDBusConnection::connectToPeer(address, QLatin1String(ConnectionName));
+        QMetaObject::invokeMethod(qApp, [this, context, newConnection] {
+            if (context)
+                connectionFinished(newConnection);
+            else
+                QDBusConnection::disconnectFromPeer(QLatin1String(ConnectionName));
+        }, Qt::QueuedConnection);
+    });
+    QObject::connect(thread, &QThread::finished, thread, &QObject::deleteLater);
+    thread->start();
 }
 
-void QMaliitPlatformInputContextPrivate::sendStateUpdate(bool focusChanged)
+void QMaliitPlatformInputContextPrivate::connectionFinished(const QDBusConnection &newConnection)
 {
-    server->updateWidgetInformation(imState, focusChanged);
+    if (!newConnection.isConnected()) {
+        if (reconnectDelay == MinReconnectDelay)
+            qWarning() << "Maliit: cannot connect to the input method server:" << newConnection.lastError().message();
+        QDBusConnection::disconnectFromPeer(QLatin1String(ConnectionName));
+        connectionState = ConnectionFailed;
+        scheduleReconnect();
+        return;
+    }
+
+    connection = newConnection;
+    if (!ioThread.isRunning())
+        ioThread.start();
+    server = new ComMeegoInputmethodUiserver1Interface(QString(""), QStringLiteral("/com/meego/inputmethod/uiserver1"), connection);
+    server->moveToThread(&ioThread);
+    if (!contextObject) {
+        contextObject = new QMaliitInputcontext1Object(q);
+        adaptor = new QMaliitInputcontext1Adaptor(contextObject);
+        contextObject->moveToThread(&ioThread);
+    }
+    connection.registerObject("/com/meego/inputmethod/inputcontext", contextObject);
+    connection.connect(QString(), QStringLiteral("/org/freedesktop/DBus/Local"),
+                       QStringLiteral("org.freedesktop.DBus.Local"), QStringLiteral("Disconnected"),
+                       q, SLOT(onDBusDisconnection()));
+    connectionState = ConnectionEstablished;
+    reconnectDelay = MinReconnectDelay;
+    failedConnectAttempts = 0;
+    everConnected = true;
+
+    QMaliitStatistics::registerOnSessionBus();
+
+    offerSharedBuffer();
+    negotiateDeltaUpdates();
+    replayState();
+
+    // Replayed calls come from the GUI thread, after the state went out
+    if (replayer)
+        replayer->start(adaptor);
+}
+
+void QMaliitPlatformInputContextPrivate::scheduleReconnect()
+{
+    if (!serverWatcher) {
+        serverWatcher = new QDBusServiceWatcher(QStringLiteral("org.maliit.server"), QDBusConnection::sessionBus(),
+                                                QDBusServiceWatcher::WatchForRegistration, q);
+        QObject::connect(serverWatcher, &QDBusServiceWatcher::serviceRegistered, q, [this] {
+            if (connectionState == ConnectionUnavailable)
+                connectionState = ConnectionFailed;
+            reconnectDelay = MinReconnectDelay;
+            failedConnectAttempts = 0;
+            connectToServer();
+        });
+    }
+
+    // A server that could never be reached is most likely not running at
+    // all, polling for it would only wake the application up for nothing
+    if (!everConnected && ++failedConnectAttempts >= MaxInitialConnectAttempts) {
+        qWarning() << "Maliit: giving up on the input method server until org.maliit.server appears";
+        connectionState = ConnectionUnavailable;
+        return;
+    }
+
+    reconnectTimer.start(reconnectDelay);
+    reconnectDelay = qMin(reconnectDelay * 2, MaxReconnectDelay);
+}
+
+void QMaliitPlatformInputContextPrivate::activateContext()
+{
+    active = true;
+    server->activateContext();
+
+    // No animation to wait for, the server just needs to know the orientation
+    if (window) {
+        orientation = orientationAngle(window->contentOrientation());
+        sendOrientation();
+    }
+}
+
+void QMaliitPlatformInputContextPrivate::hideInputPanel()
+{
+    hideTimer.stop();
+    if (isConnected())
+        server->hideInputMethod();
+    inputPanelState = InputPanelHidden;
+    q->emitInputPanelVisibleChanged();
+}
+
+void QMaliitPlatformInputContextPrivate::orientationChanged(Qt::ScreenOrientation newOrientation)
+{
+    orientation = orientationAngle(newOrientation);
+    if (!isConnected())
+        return; // sent on activation
+
+    // Let the server start relayouting while the application still rotates,
+    // but only confirm once the orientation stopped changing
+    if (orientation != sentOrientation && orientation != announcedOrientation) {
+        server->appOrientationAboutToChange(orientation);
+        announcedOrientation = orientation;
+    }
+    orientationTimer.start();
+}
+
+void QMaliitPlatformInputContextPrivate::updateCursorRectangle(const QRect &rect)
+{
+    QWindow *w = qGuiApp->focusWindow();
+    if (!w) {
+        cursorWindow = nullptr;
+        return;
+    }
+
+    // mapToGlobal() can be a window system round trip, only map again when
+    // the result could differ
+    const QTransform transform = qGuiApp->inputMethod()->inputItemTransform();
+    if (rect == cursorRect && transform == cursorTransform
+            && w == cursorWindow.data() && w->position() == cursorWindowPosition)
+        return;
+
+    cursorRect = rect;
+    cursorTransform = transform;
+    cursorWindow = w;
+    cursorWindowPosition = w->position();
+    localCursorRect = transform.mapRect(rect);
+    globalCursorRect = QRect(w->mapToGlobal(localCursorRect.topLeft()), localCursorRect.size());
+}
+
+void QMaliitPlatformInputContextPrivate::saveWindowState()
+{
+    QWindow *w = window.data();
+    if (!windowStates.contains(w))
+        QObject::connect(w, &QObject::destroyed, q, [this, w] { windowStates.remove(w); });
+    windowStates.insert(w, imState);
+}
+
+bool QMaliitPlatformInputContextPrivate::restoreWindowState()
+{
+    auto cached = windowStates.constFind(window.data());
+    if (cached == windowStates.constEnd())
+        return false;
+
+    // Overlay instead of replacing so that no key goes missing from imState,
+    // deltas can't remove keys on the server
+    for (auto it = cached->constBegin(); it != cached->constEnd(); ++it)
+        imState.insert(it.key(), it.value());
+    return true;
 }
 
+void QMaliitPlatformInputContextPrivate::sendOrientation()
+{
+    orientationTimer.stop();
+    if (!isConnected() || orientation == UnknownOrientation)
+        return;
+
+    // An announced orientation needs confirming even if it was rotated back
+    if (orientation == sentOrientation && announcedOrientation == UnknownOrientation)
+        return;
+
+    server->appOrientationChanged(orientation);
+    sentOrientation = orientation;
+    announcedOrientation = UnknownOrientation;
+}
+
+void QMaliitPlatformInputContextPrivate::replayState()
+{
+    // Bring the server up to date with whatever happened while it couldn't
+    // be reached: activation, the full state and the input panel.
+    active = false;
+    serverStateValid = false;
+    sentOrientation = UnknownOrientation;
+    announcedOrientation = UnknownOrientation;
+    attributeExtensions.invalidate();
+    attributeExtensions.flush(server);
+
+    if (q->inputMethodAccepted())
+        activateContext();
+    sendStateUpdate(/*focusChanged*/true, /*fullSnapshot*/true);
+
+    if (inputPanelState != InputPanelHidden && q->inputMethodAccepted() && window)
+        q->showInputPanel();
+}
+
+void QMaliitPlatformInputContextPrivate::sendStateUpdate(bool focusChanged, bool fullSnapshot)
+{
+    if (!isConnected())
+        return;
+
+    if (fullSnapshot || !serverStateValid || !deltaUpdatesAccepted) {
+        serverState = imState;
+        serverStateValid = true;
+        const QVariantMap state = withSharedPayloads(imState);
+        QMaliitStatistics::instance()->record(QMaliitStatistics::StateUpdateSize,
+                                              QMaliitStatistics::marshalledSize(state));
+        server->updateWidgetInformation(state, focusChanged);
+        return;
+    }
+
+    // Only send what the server has not seen yet. Keys are never removed from
+    // imState between snapshots, so comparing values is enough.
+    QVariantMap delta;
+    for (auto it = imState.constBegin(); it != imState.constEnd(); ++it) {
+        auto sent = serverState.constFind(it.key());
+        if (sent == serverState.constEnd() || sent.value() != it.value()) {
+            delta.insert(it.key(), it.value());
+            serverState.insert(it.key(), it.value());
+        }
+    }
+
+    if (delta.isEmpty() && !focusChanged)
+        return;
+
+    // With focusChanged the server reads focusState, a missing one would
+    // look like the focus went away
+    if (focusChanged)
+        delta.insert(QStringLiteral("focusState"), imState.value("focusState"));
+
+    // Tells the server to merge the keys into its copy instead of replacing it
+    delta.insert(QStringLiteral("deltaUpdate"), true);
+    delta = withSharedPayloads(delta);
+    QMaliitStatistics::instance()->record(QMaliitStatistics::StateUpdateSize,
+                                          QMaliitStatistics::marshalledSize(delta));
+    server->updateWidgetInformation(delta, focusChanged);
+}
+
+void QMaliitPlatformInputContextPrivate::flushPendingUpdate()
+{
+    MALIIT_TRACE_SCOPE("flushPendingUpdate");
+    updateTimer.stop();
+
+    Qt::InputMethodQueries queries = pendingQueries;
+    pendingQueries = Qt::InputMethodQueries();
+
+    if (!queries || !qGuiApp->focusObject())
+        return;
+
+    // Whether there is a selection follows from the cursor and anchor, which
+    // are always queried together. The selected text itself can be the
+    // whole document, so it is only fetched once the server asks for it
+    // and kept until the selection changes. An empty one is known from the
+    // positions alone.
+    const Qt::InputMethodQueries selectionQueries = Qt::ImCurrentSelection | Qt::ImCursorPosition
+            | Qt::ImAnchorPosition | Qt::ImSurroundingText;
+    if (queries & selectionQueries)
+        selectionCached = false;
+    if (queries & (Qt::ImCurrentSelection | Qt::ImCursorPosition | Qt::ImAnchorPosition)) {
+        queries &= ~Qt::ImCurrentSelection;
+        queries |= Qt::ImCursorPosition | Qt::ImAnchorPosition;
+    }
+
+    // Attribute extensions are read from properties, apps announce changes
+    // to them with ImPlatformData
+    if (queries & Qt::ImPlatformData) {
+        queries &= ~Qt::ImPlatformData;
+        const int extensionId = attributeExtensions.update(qGuiApp->focusObject());
+        imState["toolbarId"] = extensionId;
+        imState["toolbarFile"] = attributeExtensions.fileName(extensionId);
+        // Registered before the state refers to it, attribute changes of
+        // this frame go out together
+        if (isConnected())
+            attributeExtensions.flush(server);
+    }
+
+    // In window mode the text is fetched with the bounded queries instead,
+    // which need the cursor and anchor to place the window.
+    const bool windowed = surroundingTextWindow > 0
+            && (queries & (Qt::ImSurroundingText | Qt::ImCursorPosition | Qt::ImAnchorPosition));
+    Qt::InputMethodQueries eventQueries = queries;
+    if (windowed) {
+        queries |= Qt::ImCursorPosition | Qt::ImAnchorPosition;
+        eventQueries = queries;
+        eventQueries &= ~Qt::ImSurroundingText;
+    }
+
+    QInputMethodQueryEvent query(eventQueries);
+    sendToFocusObject(&query);
+
+    if (windowed) {
+        updateSurroundingTextWindow(query.value(Qt::ImCursorPosition).toInt(),
+                                    query.value(Qt::ImAnchorPosition));
+    } else {
+        if (queries & Qt::ImSurroundingText)
+            imState["surroundingText"] = query.value(Qt::ImSurroundingText);
+        if (queries & Qt::ImCursorPosition)
+            imState["cursorPosition"] = query.value(Qt::ImCursorPosition);
+        if (queries & Qt::ImAnchorPosition)
+            imState["anchorPosition"] = query.value(Qt::ImAnchorPosition);
+    }
+    if (queries & Qt::ImCursorRectangle) {
+        updateCursorRectangle(query.value(Qt::ImCursorRectangle).toRect());
+        if (cursorWindow)
+            imState["cursorRectangle"] = globalCursorRect;
+    }
+
+    if (queries & Qt::ImCursorPosition) {
+        // Focus objects without an anchor have nothing to select
+        const QVariant anchor = query.value(Qt::ImAnchorPosition);
+        const bool hasSelection = anchor.isValid() && query.value(Qt::ImCursorPosition).toInt() != anchor.toInt();
+        imState["hasSelection"] = hasSelection;
+        if (anchor.isValid() && !hasSelection) {
+            selection = QString();
+            selectionCached = true;
+        }
+    }
+
+    if (queries & Qt::ImHints) {
+        Qt::InputMethodHints hints = Qt::InputMethodHints(query.value(Qt::ImHints).toUInt());
+
+        imState["predictionEnabled"] = !(hints & Qt::ImhNoPredictiveText);
+        imState["autocapitalizationEnabled"] = !(hints & Qt::ImhNoAutoUppercase);
+        imState["hiddenText"] = (hints & Qt::ImhHiddenText) != 0;
+
+        imState["contentType"] = contentType(hints);
+    }
+
+    sendStateUpdate();
+}
+
+void QMaliitPlatformInputContextPrivate::updateSurroundingTextWindow(int cursorPosition, const QVariant &anchorPosition)
+{
+    QObject *focusObject = qGuiApp->focusObject();
+    QString before;
+    QString after;
+
+    // Prefer the bounded queries so that the focus object never has to hand
+    // out the whole document. Only call them when the object takes a query
+    // argument, otherwise QInputMethod would warn about the missing method.
+    if (focusObject->metaObject()->indexOfMethod("inputMethodQuery(Qt::InputMethodQuery,QVariant)") != -1) {
+        before = QInputMethod::queryFocusObject(Qt::ImTextBeforeCursor, surroundingTextWindow).toString();
+        after = QInputMethod::queryFocusObject(Qt::ImTextAfterCursor, surroundingTextWindow).toString();
+    } else {
+        QInputMethodQueryEvent query(Qt::ImSurroundingText);
+        sendToFocusObject(&query);
+        const QString text = query.value(Qt::ImSurroundingText).toString();
+        const int start = qMax(0, cursorPosition - surroundingTextWindow);
+        before = text.mid(start, cursorPosition - start);
+        after = text.mid(cursorPosition, surroundingTextWindow);
+    }
+
+    // The bounded queries may return more than asked for, and may reach into
+    // other blocks while ImCursorPosition is relative to the cursor's block
+    // (QTextEdit). Trimming to the cursor position keeps the window in the
+    // cursor's coordinates.
+    before = before.right(qMin(surroundingTextWindow, qMax(0, cursorPosition)));
+    after = after.left(surroundingTextWindow);
+
+    // Positions sent to the server are relative to the window, the offset maps
+    // them back to the focus object's coordinates.
+    const QString text = before + after;
+    surroundingTextOffset = cursorPosition - before.length();
+    const int anchor = anchorPosition.isValid() ? anchorPosition.toInt() : cursorPosition;
+
+    imState["surroundingText"] = text;
+    imState["surroundingTextOffset"] = surroundingTextOffset;
+    imState["cursorPosition"] = before.length();
+    // An anchor outside the window is reported at its edge, the selection
+    // still starts at the cursor and extends in the same direction
+    imState["anchorPosition"] = qBound(0, anchor - surroundingTextOffset, text.length());
+}
+
+void QMaliitPlatformInputContextPrivate::offerSharedBuffer()
+{
+    if (!(connection.connectionCapabilities() & QDBusConnection::UnixFileDescriptorPassing))
+        return;
+
+    static quint32 lastBufferId = 0;
+    delete sharedBuffer;
+    sharedBuffer = new QMaliitSharedBuffer(++lastBufferId);
+    sharedBufferAccepted = false;
+    if (!sharedBuffer->isValid())
+        return;
+
+    const quint32 id = sharedBuffer->id();
+    server->setSharedBuffer(id, QDBusUnixFileDescriptor(sharedBuffer->fileDescriptor()), sharedBuffer->size(),
+                            q, [this, id](bool ok) {
+        // An error means the server doesn't know about shared buffers
+        if (ok && sharedBuffer && sharedBuffer->id() == id)
+            sharedBufferAccepted = true;
+    });
+}
+
+void QMaliitPlatformInputContextPrivate::negotiateDeltaUpdates()
+{
+    deltaUpdatesAccepted = false;
+    QPointer<ComMeegoInputmethodUiserver1Interface> proxy(server);
+    server->enableDeltaUpdates(q, [this, proxy](bool ok) {
+        // An error means the server would replace its state with a delta.
+        // Everything up to here went out as full snapshots, so the server
+        // state is complete either way.
+        if (ok && proxy && proxy == server)
+            deltaUpdatesAccepted = true;
+    });
+}
+
+QVariantMap QMaliitPlatformInputContextPrivate::withSharedPayloads(const QVariantMap &state)
+{
+    if (!sharedBufferAccepted)
+        return state;
+
+    auto it = state.constFind(QStringLiteral("surroundingText"));
+    if (it == state.constEnd())
+        return state;
+
+    const QString text = it.value().toString();
+    const quint32 length = text.size() * sizeof(QChar);
+    quint32 offset;
+    quint64 end;
+    // A full ring means the server is behind, the text goes inline then
+    if (length < SharedBufferThreshold || !sharedBuffer->write(text.constData(), length, &offset, &end))
+        return state;
+
+    // UTF-16 text at offset in the buffer with the given id, the server
+    // releases it with end
+    QVariantList payload;
+    payload << sharedBuffer->id() << offset << length << end;
+    QVariantMap result(state);
+    result.remove(QStringLiteral("surroundingText"));
+    result.insert(QStringLiteral("surroundingTextShm"), payload);
+    return result;
+}
+
+void QMaliitPlatformInputContextPrivate::sendKeyEvent(const Maliit::KeyEventRecord &record)
+{
+    if (record.requestType == Maliit::EventRequestSignalOnly) {
+        qWarning() << "Maliit: Signal emitted key events are not supported.";
+        return;
+    }
+
+    // HACK: This code relies on QEvent::Type for key events and modifiers to be binary compatible between
+    // Qt 4 and 5.
+    QEvent::Type eventType = static_cast<QEvent::Type>(record.type);
+    if (record.type != QEvent::KeyPress && record.type != QEvent::KeyRelease) {
+        qWarning() << "Maliit: Unknown key event type" << record.type;
+        return;
+    }
+
+    if (eventType == QEvent::KeyPress)
+        keyResponseArrived();
+
+    QKeyEvent event(eventType, record.key, static_cast<Qt::KeyboardModifiers>(record.modifiers),
+                    record.text, record.autoRepeat, record.count);
+    QMaliitStatistics::Timer timer(QMaliitStatistics::FocusObjectEvent);
+    QCoreApplication::sendEvent(window.data(), &event);
+}
+
+void QMaliitPlatformInputContextPrivate::keyResponseArrived()
+{
+    if (forwardedKeys.isEmpty())
+        return;
+
+    // Keys such as modifiers never get a response of their own
+    const qint64 now = keyLatencyClock.nsecsElapsed();
+    while (!forwardedKeys.isEmpty() && now - forwardedKeys.first() > MaxKeyResponseTime)
+        forwardedKeys.removeFirst();
+    if (forwardedKeys.isEmpty())
+        return;
+
+    const qint64 latency = now - forwardedKeys.takeFirst();
+    QMaliitStatistics::instance()->record(QMaliitStatistics::KeyResponse, latency / 1000);
+
+    if (QMaliitPlatformInputContext::debug)
+        qDebug() << "Maliit: key response after" << latency / 1000 << "us";
+}
+
+bool QMaliitPlatformInputContextPrivate::sendToFocusObject(QEvent *event)
+{
+    QMaliitStatistics::Timer timer(QMaliitStatistics::FocusObjectEvent);
+    return QCoreApplication::sendEvent(qGuiApp->focusObject(), event);
+}
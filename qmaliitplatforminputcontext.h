@@ -26,7 +26,6 @@
 #include <qpa/qplatforminputcontext.h>
 
 class QMaliitPlatformInputContextPrivate;
-class QDBusMessage;
 class QMaliitPlatformInputContext : public QPlatformInputContext
 {
     Q_OBJECT
@@ -54,6 +53,7 @@ public:
     void hideInputPanel() override;
     bool isInputPanelVisible() const override;
     void setFocusObject(QObject *object) override;
+    bool filterEvent(const QEvent *event) override;
 
     QString preeditString();
 
@@ -65,10 +65,12 @@ public Q_SLOTS:
     void commitString(const QString &string, int replacementStart = 0,
                       int replacementLength = 0, int cursorPos = -1);
 
-    void updatePreedit(const QDBusMessage &message);
+    void updatePreedit(const QString &text, const QVector<Maliit::PreeditTextFormat> &formats,
+                       int replacementStart, int replacementLength, int cursorPos);
 
     void keyEvent(int type, int key, int modifiers, const QString &text, bool autoRepeat,
                   int count, uchar requestType_);
+    void keyEvents(const QVector<Maliit::KeyEventRecord> &events);
     bool preeditRectangle(int &x, int &y, int &width, int &height);
     bool selection(QString &selection);
     void updateInputMethodArea(int x, int y, int width, int height);
@@ -78,16 +80,20 @@ public Q_SLOTS:
     void setDetectableAutoRepeat(bool enabled);
     void setSelection(int start, int length);
     void setLanguage(const QString &);
+    void notifyExtendedAttributeChanged(int id, const QString &target, const QString &targetItem,
+                                        const QString &attribute, const QDBusVariant &value);
     // End input method server connection slots.
 
 private Q_SLOTS:
     void updateServerOrientation(Qt::ScreenOrientation orientation);
+    void onDBusDisconnection();
 
 Q_SIGNALS:
     void preeditChanged();
 
 private:
     QMaliitPlatformInputContextPrivate *d;
+    friend class QMaliitPlatformInputContextPrivate;
 
     static bool debug;
 };
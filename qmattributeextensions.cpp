@@ -0,0 +1,169 @@
+/* * This file is part of Maliit framework *
+ *
+ * Contact: maliit-discuss@lists.maliit.org
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * and appearing in the file LICENSE.LGPL included in the packaging
+ * of this file.
+ */
+
+#include "qmattributeextensions.h"
+
+#include "qmnamespace.h"
+#include "qmserverproxy.h"
+
+#include <QDebug>
+
+namespace
+{
+    const char * const FileNameKey = "fileName";
+    const char * const AttributesKey = "attributes";
+
+    // "/keys/actionKey/label" is target "/keys", item "actionKey", attribute "label"
+    bool splitAttributeName(const QString &name, QString *target, QString *targetItem, QString *attribute)
+    {
+        const int attributeSlash = name.lastIndexOf(QLatin1Char('/'));
+        if (attributeSlash <= 0)
+            return false;
+        const int itemSlash = name.lastIndexOf(QLatin1Char('/'), attributeSlash - 1);
+        if (itemSlash < 0)
+            return false;
+
+        *target = name.left(itemSlash);
+        *targetItem = name.mid(itemSlash + 1, attributeSlash - itemSlash - 1);
+        *attribute = name.mid(attributeSlash + 1);
+        return true;
+    }
+
+    // Does the server have attributes that are no longer declared?
+    bool hasRemovedAttributes(const QVariantMap &declared, const QVariantMap &sent)
+    {
+        for (auto it = sent.constBegin(); it != sent.constEnd(); ++it) {
+            if (!declared.contains(it.key()))
+                return true;
+        }
+        return false;
+    }
+}
+
+QMaliitAttributeExtensions::QMaliitAttributeExtensions()
+    : m_lastGeneratedId(-1)
+{
+}
+
+int QMaliitAttributeExtensions::idFor(QObject *object)
+{
+    bool ok = false;
+    const int id = object->property(Maliit::InputMethodQuery::attributeExtensionId).toInt(&ok);
+    if (ok && id >= 0)
+        return id;
+
+    for (auto it = m_extensions.constBegin(); it != m_extensions.constEnd(); ++it) {
+        if (it->generatedId && it->object == object)
+            return it.key();
+    }
+
+    // Declared ids are never negative and -1 means no extension
+    int generated;
+    do {
+        generated = --m_lastGeneratedId;
+    } while (m_extensions.contains(generated));
+    m_extensions[generated].generatedId = true;
+    return generated;
+}
+
+int QMaliitAttributeExtensions::update(QObject *object)
+{
+    if (!object)
+        return -1;
+
+    const QVariant declared = object->property(Maliit::InputMethodQuery::attributeExtension);
+    if (!declared.isValid())
+        return -1;
+
+    const QVariantMap extension = declared.toMap();
+    const int id = idFor(object);
+    Extension &e = m_extensions[id];
+    e.object = object;
+    e.fileName = extension.value(QLatin1String(FileNameKey)).toString();
+    e.attributes = extension.value(QLatin1String(AttributesKey)).toMap();
+    return id;
+}
+
+QString QMaliitAttributeExtensions::fileName(int id) const
+{
+    return m_extensions.value(id).fileName;
+}
+
+void QMaliitAttributeExtensions::flush(ComMeegoInputmethodUiserver1Interface *server)
+{
+    for (auto it = m_extensions.begin(); it != m_extensions.end();) {
+        Extension &e = it.value();
+        if (!e.object) {
+            if (e.registered)
+                server->unregisterAttributeExtension(it.key());
+            it = m_extensions.erase(it);
+            continue;
+        }
+
+        if (e.registered && (e.registeredFileName != e.fileName || hasRemovedAttributes(e.attributes, e.sent))) {
+            server->unregisterAttributeExtension(it.key());
+            e.registered = false;
+        }
+        if (!e.registered) {
+            server->registerAttributeExtension(it.key(), e.fileName);
+            e.registered = true;
+            e.registeredFileName = e.fileName;
+            e.sent.clear();
+        }
+
+        for (auto attribute = e.attributes.constBegin(); attribute != e.attributes.constEnd(); ++attribute) {
+            auto sent = e.sent.constFind(attribute.key());
+            if (sent != e.sent.constEnd() && sent.value() == attribute.value())
+                continue;
+            // Remembered either way, so that a bad name is only reported once
+            e.sent.insert(attribute.key(), attribute.value());
+
+            QString target, targetItem, name;
+            if (!splitAttributeName(attribute.key(), &target, &targetItem, &name)) {
+                qWarning() << "Maliit: ignoring malformed extended attribute" << attribute.key();
+                continue;
+            }
+            server->setExtendedAttribute(it.key(), target, targetItem, name, QDBusVariant(attribute.value()));
+        }
+        ++it;
+    }
+}
+
+void QMaliitAttributeExtensions::invalidate()
+{
+    for (auto it = m_extensions.begin(); it != m_extensions.end(); ++it) {
+        it->registered = false;
+        it->sent.clear();
+    }
+}
+
+void QMaliitAttributeExtensions::serverChanged(int id, const QString &target, const QString &targetItem,
+                                               const QString &attribute, const QVariant &value)
+{
+    auto it = m_extensions.find(id);
+    if (it == m_extensions.end())
+        return;
+
+    const QString name = target + QLatin1Char('/') + targetItem + QLatin1Char('/') + attribute;
+    it->attributes.insert(name, value);
+    it->sent.insert(name, value);
+
+    QObject *object = it->object;
+    if (!object)
+        return;
+
+    // The application sees the change as a dynamic property change
+    QVariantMap extension = object->property(Maliit::InputMethodQuery::attributeExtension).toMap();
+    QVariantMap attributes = extension.value(QLatin1String(AttributesKey)).toMap();
+    attributes.insert(name, value);
+    extension.insert(QLatin1String(AttributesKey), attributes);
+    object->setProperty(Maliit::InputMethodQuery::attributeExtension, extension);
+}
@@ -0,0 +1,82 @@
+/* * This file is part of Maliit framework *
+ *
+ * Contact: maliit-discuss@lists.maliit.org
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * and appearing in the file LICENSE.LGPL included in the packaging
+ * of this file.
+ */
+
+#ifndef QMATTRIBUTEEXTENSIONS_H
+#define QMATTRIBUTEEXTENSIONS_H
+
+#include <QHash>
+#include <QPointer>
+#include <QString>
+#include <QVariant>
+
+class ComMeegoInputmethodUiserver1Interface;
+
+/*
+ * Attribute extensions customize the keyboard for a focus object, e.g. the
+ * label or action of a key. An object declares one through the
+ * Maliit::InputMethodQuery::attributeExtension property:
+ *
+ *   {
+ *       "fileName": "/usr/share/app/keyboard.xml",  // optional
+ *       "attributes": { "/keys/actionKey/label": "Go", ... }
+ *   }
+ *
+ * Attribute names are "<target>/<targetItem>/<attribute>". Objects sharing
+ * Maliit::InputMethodQuery::attributeExtensionId share one extension, without
+ * it each object gets its own, with an id below -1 so that it can't collide
+ * with the ids applications declare.
+ *
+ * Changes are collected by update() and only reach the server with the next
+ * flush(), attributes the server already has are not sent again.
+ */
+class QMaliitAttributeExtensions
+{
+public:
+    QMaliitAttributeExtensions();
+
+    //! Reads the extension of \a object, returns its id or -1 if it has none
+    int update(QObject *object);
+    QString fileName(int id) const;
+
+    //! Registers new extensions, sends changed attributes and unregisters
+    //! the extensions of destroyed objects. Extensions that dropped attributes
+    //! are registered again, the protocol can't remove single attributes.
+    void flush(ComMeegoInputmethodUiserver1Interface *server);
+    //! The server forgot about all extensions, the next flush() sends everything
+    void invalidate();
+
+    //! Takes over an attribute the server changed and applies it to the object
+    void serverChanged(int id, const QString &target, const QString &targetItem,
+                       const QString &attribute, const QVariant &value);
+
+private:
+    Q_DISABLE_COPY(QMaliitAttributeExtensions)
+
+    struct Extension
+    {
+        Extension() : generatedId(false), registered(false) {}
+
+        QPointer<QObject> object; // last object that used the extension
+        bool generatedId;
+        bool registered;
+        QString fileName;
+        QString registeredFileName; // fileName the server knows the extension by
+        QVariantMap attributes; // as the object declares them
+        QVariantMap sent; // as the server has them
+    };
+
+    int idFor(QObject *object);
+
+    QHash<int, Extension> m_extensions;
+    int m_lastGeneratedId; // counts down from -1
+};
+
+#endif
@@ -5,12 +5,15 @@
  * qdbusxml2cpp is Copyright (C) 2016 The Qt Company Ltd.
  *
  * This is an auto-generated file.
- * Do not edit! All changes made to it will be lost.
+ * This file may have been hand-edited. Look for HAND-EDIT comments
+ * before re-generating it.
  */
 
 #include "qmcontextadaptor.h"
 
 #include "qmaliitplatforminputcontext.h"
+#include "qmsessionrecorder.h"
+#include "qmstatistics.h"
 
 #include <QtCore/QMetaObject>
 #include <QtCore/QByteArray>
@@ -19,16 +22,67 @@
 #include <QtCore/QString>
 #include <QtCore/QStringList>
 #include <QtCore/QVariant>
+#include <QtCore/QThread>
+#include <QtCore/QElapsedTimer>
 
 /*
  * Implementation of adaptor class QMaliitInputcontext1Adaptor
  */
 
-QMaliitInputcontext1Adaptor::QMaliitInputcontext1Adaptor(QObject *parent)
+QDBusArgument &operator<<(QDBusArgument &argument, const Maliit::PreeditTextFormat &format)
+{
+    argument.beginStructure();
+    argument << format.start << format.length << int(format.preeditFace);
+    argument.endStructure();
+    return argument;
+}
+
+const QDBusArgument &operator>>(const QDBusArgument &argument, Maliit::PreeditTextFormat &format)
+{
+    int preeditFace;
+    argument.beginStructure();
+    argument >> format.start >> format.length >> preeditFace;
+    argument.endStructure();
+    format.preeditFace = Maliit::PreeditFace(preeditFace);
+    return argument;
+}
+
+QDBusArgument &operator<<(QDBusArgument &argument, const Maliit::KeyEventRecord &record)
+{
+    argument.beginStructure();
+    argument << record.type << record.key << record.modifiers << record.text
+             << record.autoRepeat << record.count << uchar(record.requestType);
+    argument.endStructure();
+    return argument;
+}
+
+const QDBusArgument &operator>>(const QDBusArgument &argument, Maliit::KeyEventRecord &record)
+{
+    uchar requestType;
+    argument.beginStructure();
+    argument >> record.type >> record.key >> record.modifiers >> record.text
+             >> record.autoRepeat >> record.count >> requestType;
+    argument.endStructure();
+    record.requestType = Maliit::EventRequestType(requestType);
+    return argument;
+}
+
+QMaliitInputcontext1Adaptor::QMaliitInputcontext1Adaptor(QMaliitInputcontext1Object *parent)
     : QDBusAbstractAdaptor(parent)
 {
     // constructor
     setAutoRelaySignals(true);
+    // HAND-EDIT
+    qDBusRegisterMetaType<Maliit::PreeditTextFormat>();
+    qDBusRegisterMetaType<QVector<Maliit::PreeditTextFormat> >();
+    qDBusRegisterMetaType<Maliit::KeyEventRecord>();
+    qDBusRegisterMetaType<QVector<Maliit::KeyEventRecord> >();
+
+    QStringList methodNames;
+    for (int i = staticMetaObject.methodOffset(); i < staticMetaObject.methodCount(); ++i)
+        methodNames << QString::fromLatin1(staticMetaObject.method(i).name());
+    Q_ASSERT(methodNames.size() == MethodCount);
+    QMaliitStatistics::instance()->setMethodNames(QMaliitStatistics::Inbound, methodNames);
 }
 
 QMaliitInputcontext1Adaptor::~QMaliitInputcontext1Adaptor()
@@ -36,87 +90,223 @@ QMaliitInputcontext1Adaptor::~QMaliitInputcontext1Adaptor()
     // destructor
 }
 
+// HAND-EDIT: calls are dispatched directly to the context instead of through
+// QMetaObject::invokeMethod, which looks the slot up by name on every call.
+QMaliitPlatformInputContext *QMaliitInputcontext1Adaptor::context() const
+{
+    return static_cast<QMaliitInputcontext1Object *>(parent())->context();
+}
+
+// HAND-EDIT: runs function on the context's thread, in order with other calls
+template <typename Function>
+void QMaliitInputcontext1Adaptor::dispatch(Function function) const
+{
+    if (QThread::currentThread() == context()->thread())
+        function();
+    else
+        QMetaObject::invokeMethod(context(), function, Qt::QueuedConnection);
+}
+
+// HAND-EDIT: like dispatch(), for the calls that deliver input. The time
+// until the application handled them counts from here, so that it includes
+// waiting for the GUI thread.
+template <typename Function>
+void QMaliitInputcontext1Adaptor::dispatchInput(Function function) const
+{
+    QElapsedTimer received;
+    received.start();
+    dispatch([function, received] {
+        QMaliitStatistics::Timer timer(QMaliitStatistics::InboundDispatch, received);
+        function();
+    });
+}
+
+// HAND-EDIT: function returns the reply arguments and must run on the
+// context's thread. Calls from D-Bus are answered without blocking the
+// D-Bus thread and return true, the immediate reply is discarded. Otherwise reply is filled in before returning false.
+template <typename Function>
+bool QMaliitInputcontext1Adaptor::dispatchWithReply(Function function, QVariantList *reply) const
+{
+    if (QThread::currentThread() == context()->thread()) {
+        *reply = function();
+        return false;
+    }
+
+    QMaliitInputcontext1Object *object = static_cast<QMaliitInputcontext1Object *>(parent());
+    if (!object->calledFromDBus()) {
+        // Nobody to send a delayed reply to, wait for the answer instead.
+        // The GUI thread never waits for the D-Bus thread, so this can't deadlock.
+        QMetaObject::invokeMethod(context(), [function, reply] { *reply = function(); },
+                                  Qt::BlockingQueuedConnection);
+        return false;
+    }
+
+    object->setDelayedReply(true);
+    const QDBusMessage call = object->message();
+    QDBusConnection connection = object->connection();
+    QMetaObject::invokeMethod(context(), [object, function, call, connection] {
+        const QDBusMessage reply = call.createReply(function());
+        // The object shares the D-Bus thread with the server proxy, so the
+        // reply goes out behind the calls function queued there, e.g. the
+        // state update it flushed
+        QMetaObject::invokeMethod(object, [reply, connection]() mutable {
+            connection.send(reply);
+        }, Qt::QueuedConnection);
+    }, Qt::QueuedConnection);
+    return true;
+}
+
 void QMaliitInputcontext1Adaptor::activationLostEvent()
 {
     // handle method call com.meego.inputmethod.inputcontext1.activationLostEvent
-    QMetaObject::invokeMethod(parent(), "activationLostEvent");
+    QMaliitStatistics::instance()->countInbound(ActivationLostEvent);
+    if (QMaliitSessionRecorder *recorder = QMaliitSessionRecorder::instance())
+        recorder->recordInbound("activationLostEvent", QVariantList());
+    dispatch([this] { context()->activationLostEvent(); });
 }
 
 void QMaliitInputcontext1Adaptor::commitString(const QString &in0, int in1, int in2, int in3)
 {
     // handle method call com.meego.inputmethod.inputcontext1.commitString
-    QMetaObject::invokeMethod(parent(), "commitString", Q_ARG(QString, in0), Q_ARG(int, in1), Q_ARG(int, in2), Q_ARG(int, in3));
+    QMaliitStatistics::instance()->countInbound(CommitString);
+    if (QMaliitSessionRecorder *recorder = QMaliitSessionRecorder::instance())
+        recorder->recordInbound("commitString", QVariantList() << QVariant::fromValue(in0) << QVariant::fromValue(in1) << QVariant::fromValue(in2) << QVariant::fromValue(in3));
+    dispatchInput([=] { context()->commitString(in0, in1, in2, in3); });
 }
 
 void QMaliitInputcontext1Adaptor::imInitiatedHide()
 {
     // handle method call com.meego.inputmethod.inputcontext1.imInitiatedHide
-    QMetaObject::invokeMethod(parent(), "imInitiatedHide");
+    QMaliitStatistics::instance()->countInbound(ImInitiatedHide);
+    if (QMaliitSessionRecorder *recorder = QMaliitSessionRecorder::instance())
+        recorder->recordInbound("imInitiatedHide", QVariantList());
+    dispatch([this] { context()->imInitiatedHide(); });
 }
 
 void QMaliitInputcontext1Adaptor::keyEvent(int in0, int in1, int in2, const QString &in3, bool in4, int in5, uchar in6)
 {
     // handle method call com.meego.inputmethod.inputcontext1.keyEvent
-    QMetaObject::invokeMethod(parent(), "keyEvent", Q_ARG(int, in0), Q_ARG(int, in1), Q_ARG(int, in2), Q_ARG(QString, in3), Q_ARG(bool, in4), Q_ARG(int, in5), Q_ARG(uchar, in6));
+    QMaliitStatistics::instance()->countInbound(KeyEvent);
+    if (QMaliitSessionRecorder *recorder = QMaliitSessionRecorder::instance())
+        recorder->recordInbound("keyEvent", QVariantList() << QVariant::fromValue(in0) << QVariant::fromValue(in1) << QVariant::fromValue(in2) << QVariant::fromValue(in3) << QVariant::fromValue(in4) << QVariant::fromValue(in5) << QVariant::fromValue(in6));
+    dispatchInput([=] { context()->keyEvent(in0, in1, in2, in3, in4, in5, in6); });
+}
+
+void QMaliitInputcontext1Adaptor::keyEvents(const QVector<Maliit::KeyEventRecord> &in0)
+{
+    // handle method call com.meego.inputmethod.inputcontext1.keyEvents
+    QMaliitStatistics::instance()->countInbound(KeyEvents);
+    if (QMaliitSessionRecorder *recorder = QMaliitSessionRecorder::instance())
+        recorder->recordInbound("keyEvents", QVariantList() << QVariant::fromValue(in0));
+    dispatchInput([=] { context()->keyEvents(in0); });
 }
 
 void QMaliitInputcontext1Adaptor::notifyExtendedAttributeChanged(int in0, const QString &in1, const QString &in2, const QString &in3, const QDBusVariant &in4)
 {
     // handle method call com.meego.inputmethod.inputcontext1.notifyExtendedAttributeChanged
-    QMetaObject::invokeMethod(parent(), "notifyExtendedAttributeChanged", Q_ARG(int, in0), Q_ARG(QString, in1), Q_ARG(QString, in2), Q_ARG(QString, in3), Q_ARG(QDBusVariant, in4));
+    QMaliitStatistics::instance()->countInbound(NotifyExtendedAttributeChanged);
+    if (QMaliitSessionRecorder *recorder = QMaliitSessionRecorder::instance())
+        recorder->recordInbound("notifyExtendedAttributeChanged", QVariantList() << QVariant::fromValue(in0) << QVariant::fromValue(in1) << QVariant::fromValue(in2) << QVariant::fromValue(in3) << QVariant::fromValue(in4));
+    dispatch([=] { context()->notifyExtendedAttributeChanged(in0, in1, in2, in3, in4); });
 }
 
 bool QMaliitInputcontext1Adaptor::preeditRectangle(int &out1, int &out2, int &out3, int &out4)
 {
     // handle method call com.meego.inputmethod.inputcontext1.preeditRectangle
-    return static_cast<QMaliitPlatformInputContext *>(parent())->preeditRectangle(out1, out2, out3, out4);
+    QMaliitStatistics::instance()->countInbound(PreeditRectangle);
+    if (QMaliitSessionRecorder *recorder = QMaliitSessionRecorder::instance())
+        recorder->recordInbound("preeditRectangle", QVariantList());
+    QVariantList reply;
+    if (dispatchWithReply([this] {
+            int x = 0, y = 0, width = 0, height = 0;
+            const bool valid = context()->preeditRectangle(x, y, width, height);
+            return QVariantList() << valid << x << y << width << height;
+        }, &reply))
+        return false;
+    out1 = reply.at(1).toInt();
+    out2 = reply.at(2).toInt();
+    out3 = reply.at(3).toInt();
+    out4 = reply.at(4).toInt();
+    return reply.at(0).toBool();
 }
 
 bool QMaliitInputcontext1Adaptor::selection(QString &out1)
 {
     // handle method call com.meego.inputmethod.inputcontext1.selection
-    return static_cast<QMaliitPlatformInputContext *>(parent())->selection(out1);
+    QMaliitStatistics::instance()->countInbound(Selection);
+    if (QMaliitSessionRecorder *recorder = QMaliitSessionRecorder::instance())
+        recorder->recordInbound("selection", QVariantList());
+    QVariantList reply;
+    if (dispatchWithReply([this] {
+            QString text;
+            const bool valid = context()->selection(text);
+            return QVariantList() << valid << text;
+        }, &reply))
+        return false;
+    out1 = reply.at(1).toString();
+    return reply.at(0).toBool();
 }
 
 void QMaliitInputcontext1Adaptor::setDetectableAutoRepeat(bool in0)
 {
     // handle method call com.meego.inputmethod.inputcontext1.setDetectableAutoRepeat
-    QMetaObject::invokeMethod(parent(), "setDetectableAutoRepeat", Q_ARG(bool, in0));
+    QMaliitStatistics::instance()->countInbound(SetDetectableAutoRepeat);
+    if (QMaliitSessionRecorder *recorder = QMaliitSessionRecorder::instance())
+        recorder->recordInbound("setDetectableAutoRepeat", QVariantList() << QVariant::fromValue(in0));
+    dispatch([=] { context()->setDetectableAutoRepeat(in0); });
 }
 
 void QMaliitInputcontext1Adaptor::setGlobalCorrectionEnabled(bool in0)
 {
     // handle method call com.meego.inputmethod.inputcontext1.setGlobalCorrectionEnabled
-    QMetaObject::invokeMethod(parent(), "setGlobalCorrectionEnabled", Q_ARG(bool, in0));
+    QMaliitStatistics::instance()->countInbound(SetGlobalCorrectionEnabled);
+    if (QMaliitSessionRecorder *recorder = QMaliitSessionRecorder::instance())
+        recorder->recordInbound("setGlobalCorrectionEnabled", QVariantList() << QVariant::fromValue(in0));
+    dispatch([=] { context()->setGlobalCorrectionEnabled(in0); });
 }
 
 void QMaliitInputcontext1Adaptor::setLanguage(const QString &in0)
 {
     // handle method call com.meego.inputmethod.inputcontext1.setLanguage
-    QMetaObject::invokeMethod(parent(), "setLanguage", Q_ARG(QString, in0));
+    QMaliitStatistics::instance()->countInbound(SetLanguage);
+    if (QMaliitSessionRecorder *recorder = QMaliitSessionRecorder::instance())
+        recorder->recordInbound("setLanguage", QVariantList() << QVariant::fromValue(in0));
+    dispatch([=] { context()->setLanguage(in0); });
 }
 
 void QMaliitInputcontext1Adaptor::setRedirectKeys(bool in0)
 {
     // handle method call com.meego.inputmethod.inputcontext1.setRedirectKeys
-    QMetaObject::invokeMethod(parent(), "setRedirectKeys", Q_ARG(bool, in0));
+    QMaliitStatistics::instance()->countInbound(SetRedirectKeys);
+    if (QMaliitSessionRecorder *recorder = QMaliitSessionRecorder::instance())
+        recorder->recordInbound("setRedirectKeys", QVariantList() << QVariant::fromValue(in0));
+    dispatch([=] { context()->setRedirectKeys(in0); });
 }
 
 void QMaliitInputcontext1Adaptor::setSelection(int in0, int in1)
 {
     // handle method call com.meego.inputmethod.inputcontext1.setSelection
-    QMetaObject::invokeMethod(parent(), "setSelection", Q_ARG(int, in0), Q_ARG(int, in1));
+    QMaliitStatistics::instance()->countInbound(SetSelection);
+    if (QMaliitSessionRecorder *recorder = QMaliitSessionRecorder::instance())
+        recorder->recordInbound("setSelection", QVariantList() << QVariant::fromValue(in0) << QVariant::fromValue(in1));
+    dispatch([=] { context()->setSelection(in0, in1); });
 }
 
 void QMaliitInputcontext1Adaptor::updateInputMethodArea(int in0, int in1, int in2, int in3)
 {
     // handle method call com.meego.inputmethod.inputcontext1.updateInputMethodArea
-    QMetaObject::invokeMethod(parent(), "updateInputMethodArea", Q_ARG(int, in0), Q_ARG(int, in1), Q_ARG(int, in2), Q_ARG(int, in3));
+    QMaliitStatistics::instance()->countInbound(UpdateInputMethodArea);
+    if (QMaliitSessionRecorder *recorder = QMaliitSessionRecorder::instance())
+        recorder->recordInbound("updateInputMethodArea", QVariantList() << QVariant::fromValue(in0) << QVariant::fromValue(in1) << QVariant::fromValue(in2) << QVariant::fromValue(in3));
+    dispatch([=] { context()->updateInputMethodArea(in0, in1, in2, in3); });
 }
 
-void QMaliitInputcontext1Adaptor::updatePreedit(const QDBusMessage &message)
+void QMaliitInputcontext1Adaptor::updatePreedit(const QString &in0, const QVector<Maliit::PreeditTextFormat> &in1, int in2, int in3, int in4)
 {
     // handle method call com.meego.inputmethod.inputcontext1.updatePreedit
-    QMetaObject::invokeMethod(parent(), "updatePreedit", Q_ARG(QDBusMessage, message));
+    QMaliitStatistics::instance()->countInbound(UpdatePreedit);
+    if (QMaliitSessionRecorder *recorder = QMaliitSessionRecorder::instance())
+        recorder->recordInbound("updatePreedit", QVariantList() << QVariant::fromValue(in0) << QVariant::fromValue(in1) << QVariant::fromValue(in2) << QVariant::fromValue(in3) << QVariant::fromValue(in4));
+    dispatchInput([=] { context()->updatePreedit(in0, in1, in2, in3, in4); });
 }
 
@@ -25,6 +25,32 @@ class QStringList;
 class QVariant;
 QT_END_NAMESPACE
 
+class QMaliitPlatformInputContext;
+
+// HAND-EDIT: lets QtDBus decode the struct arrays straight into vectors
+QDBusArgument &operator<<(QDBusArgument &argument, const Maliit::PreeditTextFormat &format);
+const QDBusArgument &operator>>(const QDBusArgument &argument, Maliit::PreeditTextFormat &format);
+QDBusArgument &operator<<(QDBusArgument &argument, const Maliit::KeyEventRecord &record);
+const QDBusArgument &operator>>(const QDBusArgument &argument, Maliit::KeyEventRecord &record);
+
+// HAND-EDIT: the object the adaptor is registered on. It lives on the D-Bus
+// thread, so calls are read and demarshalled there and only the context's
+// work runs on the GUI thread. QDBusContext lets out-parameter calls reply
+// once the GUI thread has the answer.
+class QMaliitInputcontext1Object: public QObject, public QDBusContext
+{
+    Q_OBJECT
+public:
+    explicit QMaliitInputcontext1Object(QMaliitPlatformInputContext *context)
+        : m_context(context)
+    {}
+
+    QMaliitPlatformInputContext *context() const { return m_context; }
+
+private:
+    QMaliitPlatformInputContext *m_context;
+};
+
 /*
  * Adaptor class for interface com.meego.inputmethod.inputcontext1
  */
@@ -43,7 +69,7 @@ class QMaliitInputcontext1Adaptor: public QDBusAbstractAdaptor
 "      <arg type=\"i\"/>\n"
 "    </method>\n"
 "    <method name=\"updatePreedit\">\n"
-"      <annotation value=\"QList&lt;Maliit::PreeditTextFormat&gt;\" name=\"org.qtproject.QtDBus.QtTypeName.In1\"/>\n"
+"      <annotation value=\"QVector&lt;Maliit::PreeditTextFormat&gt;\" name=\"org.qtproject.QtDBus.QtTypeName.In1\"/>\n"
 "      <arg type=\"s\"/>\n"
 "      <arg type=\"a(iii)\"/>\n"
 "      <arg type=\"i\"/>\n"
@@ -60,6 +86,10 @@ class QMaliitInputcontext1Adaptor: public QDBusAbstractAdaptor
 "      <arg type=\"i\"/>\n"
 "      <arg type=\"y\"/>\n"
 "    </method>\n"
+"    <method name=\"keyEvents\">\n"
+"      <annotation value=\"QVector&lt;Maliit::KeyEventRecord&gt;\" name=\"org.qtproject.QtDBus.QtTypeName.In0\"/>\n"
+"      <arg type=\"a(iiisbiy)\"/>\n"
+"    </method>\n"
 "    <method name=\"updateInputMethodArea\">\n"
 "      <arg type=\"i\"/>\n"
 "      <arg type=\"i\"/>\n"
@@ -103,7 +133,7 @@ class QMaliitInputcontext1Adaptor: public QDBusAbstractAdaptor
 "  </interface>\n"
         "")
 public:
-    QMaliitInputcontext1Adaptor(QObject *parent);
+    QMaliitInputcontext1Adaptor(QMaliitInputcontext1Object *parent);
     virtual ~QMaliitInputcontext1Adaptor();
 
 public: // PROPERTIES
@@ -112,6 +142,7 @@ public Q_SLOTS: // METHODS
     void commitString(const QString &in0, int in1, int in2, int in3);
     void imInitiatedHide();
     void keyEvent(int in0, int in1, int in2, const QString &in3, bool in4, int in5, uchar in6);
+    void keyEvents(const QVector<Maliit::KeyEventRecord> &in0);
     void notifyExtendedAttributeChanged(int in0, const QString &in1, const QString &in2, const QString &in3, const QDBusVariant &in4);
     bool preeditRectangle(int &out1, int &out2, int &out3, int &out4);
     bool selection(QString &out1);
@@ -121,8 +152,35 @@ public Q_SLOTS: // METHODS
     void setRedirectKeys(bool in0);
     void setSelection(int in0, int in1);
     void updateInputMethodArea(int in0, int in1, int in2, int in3);
-    void updatePreedit(const QDBusMessage &message);
+    void updatePreedit(const QString &in0, const QVector<Maliit::PreeditTextFormat> &in1, int in2, int in3, int in4);
 Q_SIGNALS: // SIGNALS
+
+private:
+    // HAND-EDIT: the slots' method indices, for the statistics counters
+    enum Method {
+        ActivationLostEvent,
+        CommitString,
+        ImInitiatedHide,
+        KeyEvent,
+        KeyEvents,
+        NotifyExtendedAttributeChanged,
+        PreeditRectangle,
+        Selection,
+        SetDetectableAutoRepeat,
+        SetGlobalCorrectionEnabled,
+        SetLanguage,
+        SetRedirectKeys,
+        SetSelection,
+        UpdateInputMethodArea,
+        UpdatePreedit,
+        MethodCount
+    };
+
+    // HAND-EDIT
+    QMaliitPlatformInputContext *context() const;
+    template <typename Function> void dispatch(Function function) const;
+    template <typename Function> void dispatchInput(Function function) const;
+    template <typename Function> bool dispatchWithReply(Function function, QVariantList *reply) const;
 };
 
 #endif
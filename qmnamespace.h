@@ -17,6 +17,8 @@
 
 #include <QMetaType>
 #include <QSharedPointer>
+#include <QString>
+#include <QVector>
 
 //! \ingroup common
 namespace Maliit {
@@ -122,6 +124,40 @@ namespace Maliit {
         {};
     };
 
+    inline bool operator==(const PreeditTextFormat &a, const PreeditTextFormat &b)
+    {
+        return a.start == b.start && a.length == b.length && a.preeditFace == b.preeditFace;
+    }
+
+    inline bool operator!=(const PreeditTextFormat &a, const PreeditTextFormat &b)
+    {
+        return !(a == b);
+    }
+
+    /*!
+     * \brief A key press or release, as sent in batches to \a MInputContext::keyEvents().
+     *
+     * \sa EventRequestType.
+     */
+    struct KeyEventRecord {
+        int type;
+        int key;
+        int modifiers;
+        QString text;
+        bool autoRepeat;
+        int count;
+        EventRequestType requestType;
+
+        KeyEventRecord()
+            : type(0), key(0), modifiers(0), autoRepeat(false), count(1), requestType(EventRequestBoth)
+        {};
+
+        KeyEventRecord(int t, int k, int m, const QString &txt, bool repeat, int c,
+                       EventRequestType request)
+            : type(t), key(k), modifiers(m), text(txt), autoRepeat(repeat), count(c), requestType(request)
+        {};
+    };
+
     namespace InputMethodQuery
     {
         //! Name of property which tells whether correction is enabled.
@@ -175,5 +211,8 @@ namespace Maliit {
 Q_DECLARE_METATYPE(Maliit::TextContentType)
 Q_DECLARE_METATYPE(Maliit::PreeditTextFormat)
 Q_DECLARE_METATYPE(QList<Maliit::PreeditTextFormat>)
+Q_DECLARE_METATYPE(QVector<Maliit::PreeditTextFormat>)
+Q_DECLARE_METATYPE(Maliit::KeyEventRecord)
+Q_DECLARE_METATYPE(QVector<Maliit::KeyEventRecord>)
 
 #endif
@@ -17,6 +17,32 @@
 ComMeegoInputmethodUiserver1Interface::ComMeegoInputmethodUiserver1Interface(const QString &service, const QString &path, const QDBusConnection &connection, QObject *parent)
     : QDBusAbstractInterface(service, path, staticInterfaceName(), connection, parent)
 {
+    // HAND-EDIT: prebuilt messages for send() and invoke(), in Method order
+    static const char *const methodNames[MethodCount] = {
+        "activateContext",
+        "appOrientationAboutToChange",
+        "appOrientationChanged",
+        "enableDeltaUpdates",
+        "hideInputMethod",
+        "mouseClickedOnPreedit",
+        "processKeyEvent",
+        "registerAttributeExtension",
+        "reset",
+        "setCopyPasteState",
+        "setExtendedAttribute",
+        "setPreedit",
+        "setSharedBuffer",
+        "showInputMethod",
+        "unregisterAttributeExtension",
+        "updateWidgetInformation"
+    };
+    QStringList names;
+    for (int i = 0; i < MethodCount; ++i) {
+        m_messages[i] = QDBusMessage::createMethodCall(service, path, QLatin1String(staticInterfaceName()),
+                                                       QLatin1String(methodNames[i]));
+        names << QLatin1String(methodNames[i]);
+    }
+    QMaliitStatistics::instance()->setMethodNames(QMaliitStatistics::Outbound, names);
 }
 
 ComMeegoInputmethodUiserver1Interface::~ComMeegoInputmethodUiserver1Interface()
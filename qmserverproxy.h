@@ -5,13 +5,17 @@
  * qdbusxml2cpp is Copyright (C) 2016 The Qt Company Ltd.
  *
  * This is an auto-generated file.
- * Do not edit! All changes made to it will be lost.
+ * This file may have been hand-edited. Look for HAND-EDIT comments
+ * before re-generating it.
  */
 
 #ifndef QMSERVERPROXY_H
 #define QMSERVERPROXY_H
 
 #include "qmnamespace.h"
+#include "qmsessionrecorder.h"
+#include "qmstatistics.h"
+#include "qmtrace.h"
 
 #include <QtCore/QObject>
 #include <QtCore/QByteArray>
@@ -38,102 +42,180 @@ public:
     ~ComMeegoInputmethodUiserver1Interface();
 
 public Q_SLOTS: // METHODS
-    inline QDBusPendingReply<> activateContext()
+    // HAND-EDIT: nobody waits for the void replies of most methods, they are
+    // sent without asking for one. reset() and setSharedBuffer() also come
+    // with a callback for the reply, see below.
+    inline void activateContext()
     {
-        QList<QVariant> argumentList;
-        return asyncCallWithArgumentList(QStringLiteral("activateContext"), argumentList);
+        send(ActivateContext, QList<QVariant>());
     }
 
-    inline QDBusPendingReply<> appOrientationAboutToChange(int angle)
+    inline void appOrientationAboutToChange(int angle)
     {
-        QList<QVariant> argumentList;
-        argumentList << QVariant::fromValue(angle);
-        return asyncCallWithArgumentList(QStringLiteral("appOrientationAboutToChange"), argumentList);
+        send(AppOrientationAboutToChange, QList<QVariant>() << angle);
     }
 
-    inline QDBusPendingReply<> appOrientationChanged(int angle)
+    inline void appOrientationChanged(int angle)
     {
-        QList<QVariant> argumentList;
-        argumentList << QVariant::fromValue(angle);
-        return asyncCallWithArgumentList(QStringLiteral("appOrientationChanged"), argumentList);
+        send(AppOrientationChanged, QList<QVariant>() << angle);
     }
 
-    inline QDBusPendingReply<> hideInputMethod()
+    inline void hideInputMethod()
     {
-        QList<QVariant> argumentList;
-        return asyncCallWithArgumentList(QStringLiteral("hideInputMethod"), argumentList);
+        send(HideInputMethod, QList<QVariant>());
     }
 
-    inline QDBusPendingReply<> mouseClickedOnPreedit(int posX, int posY, int preeditRectX, int preeditRectY, int preeditRectWidth, int preeditRectHeight)
+    inline void mouseClickedOnPreedit(int posX, int posY, int preeditRectX, int preeditRectY, int preeditRectWidth, int preeditRectHeight)
     {
         QList<QVariant> argumentList;
-        argumentList << QVariant::fromValue(posX) << QVariant::fromValue(posY) << QVariant::fromValue(preeditRectX) << QVariant::fromValue(preeditRectY) << QVariant::fromValue(preeditRectWidth) << QVariant::fromValue(preeditRectHeight);
-        return asyncCallWithArgumentList(QStringLiteral("mouseClickedOnPreedit"), argumentList);
+        argumentList.reserve(6);
+        argumentList << posX << posY << preeditRectX << preeditRectY << preeditRectWidth << preeditRectHeight;
+        send(MouseClickedOnPreedit, argumentList);
     }
 
-    inline QDBusPendingReply<> processKeyEvent(int keyType, int keyCode, int modifiers, const QString &text, bool autoRepeat, int count, uint nativeScanCode, uint nativeModifiers, uint time)
+    inline void processKeyEvent(int keyType, int keyCode, int modifiers, const QString &text, bool autoRepeat, int count, uint nativeScanCode, uint nativeModifiers, uint time)
     {
         QList<QVariant> argumentList;
-        argumentList << QVariant::fromValue(keyType) << QVariant::fromValue(keyCode) << QVariant::fromValue(modifiers) << QVariant::fromValue(text) << QVariant::fromValue(autoRepeat) << QVariant::fromValue(count) << QVariant::fromValue(nativeScanCode) << QVariant::fromValue(nativeModifiers) << QVariant::fromValue(time);
-        return asyncCallWithArgumentList(QStringLiteral("processKeyEvent"), argumentList);
+        argumentList.reserve(9);
+        argumentList << keyType << keyCode << modifiers << text << autoRepeat << count << nativeScanCode << nativeModifiers << time;
+        send(ProcessKeyEvent, argumentList);
     }
 
-    inline QDBusPendingReply<> registerAttributeExtension(int id, const QString &fileName)
+    inline void registerAttributeExtension(int id, const QString &fileName)
     {
-        QList<QVariant> argumentList;
-        argumentList << QVariant::fromValue(id) << QVariant::fromValue(fileName);
-        return asyncCallWithArgumentList(QStringLiteral("registerAttributeExtension"), argumentList);
+        send(RegisterAttributeExtension, QList<QVariant>() << id << fileName);
     }
 
-    inline QDBusPendingReply<> reset()
+    inline void reset()
     {
-        QList<QVariant> argumentList;
-        return asyncCallWithArgumentList(QStringLiteral("reset"), argumentList);
+        send(Reset, QList<QVariant>());
     }
 
-    inline QDBusPendingReply<> setCopyPasteState(bool copyAvailable, bool pasteAvailable)
+    inline void setCopyPasteState(bool copyAvailable, bool pasteAvailable)
     {
-        QList<QVariant> argumentList;
-        argumentList << QVariant::fromValue(copyAvailable) << QVariant::fromValue(pasteAvailable);
-        return asyncCallWithArgumentList(QStringLiteral("setCopyPasteState"), argumentList);
+        send(SetCopyPasteState, QList<QVariant>() << copyAvailable << pasteAvailable);
     }
 
-    inline QDBusPendingReply<> setExtendedAttribute(int id, const QString &target, const QString &targetItem, const QString &attribute, const QDBusVariant &value)
+    inline void setExtendedAttribute(int id, const QString &target, const QString &targetItem, const QString &attribute, const QDBusVariant &value)
     {
         QList<QVariant> argumentList;
-        argumentList << QVariant::fromValue(id) << QVariant::fromValue(target) << QVariant::fromValue(targetItem) << QVariant::fromValue(attribute) << QVariant::fromValue(value);
-        return asyncCallWithArgumentList(QStringLiteral("setExtendedAttribute"), argumentList);
+        argumentList.reserve(5);
+        argumentList << id << target << targetItem << attribute << QVariant::fromValue(value);
+        send(SetExtendedAttribute, argumentList);
     }
 
-    inline QDBusPendingReply<> setPreedit(const QString &text, int cursorPos)
+    inline void setPreedit(const QString &text, int cursorPos)
     {
-        QList<QVariant> argumentList;
-        argumentList << QVariant::fromValue(text) << QVariant::fromValue(cursorPos);
-        return asyncCallWithArgumentList(QStringLiteral("setPreedit"), argumentList);
+        send(SetPreedit, QList<QVariant>() << text << cursorPos);
     }
 
-    inline QDBusPendingReply<> showInputMethod()
+    inline void showInputMethod()
     {
-        QList<QVariant> argumentList;
-        return asyncCallWithArgumentList(QStringLiteral("showInputMethod"), argumentList);
+        send(ShowInputMethod, QList<QVariant>());
     }
 
-    inline QDBusPendingReply<> unregisterAttributeExtension(int id)
+    inline void unregisterAttributeExtension(int id)
     {
-        QList<QVariant> argumentList;
-        argumentList << QVariant::fromValue(id);
-        return asyncCallWithArgumentList(QStringLiteral("unregisterAttributeExtension"), argumentList);
+        send(UnregisterAttributeExtension, QList<QVariant>() << id);
     }
 
-    inline QDBusPendingReply<> updateWidgetInformation(const QVariantMap &stateInformation, bool focusChanged)
+    inline void updateWidgetInformation(const QVariantMap &stateInformation, bool focusChanged)
     {
-        QList<QVariant> argumentList;
-        argumentList << QVariant::fromValue(stateInformation) << QVariant::fromValue(focusChanged);
-        return asyncCallWithArgumentList(QStringLiteral("updateWidgetInformation"), argumentList);
+        send(UpdateWidgetInformation, QList<QVariant>() << stateInformation << focusChanged);
     }
 
 Q_SIGNALS: // SIGNALS
     void invokeAction(const QString &action, const QString &sequence);
+
+public:
+    // HAND-EDIT: awaitable calls. finished(bool ok) is called on receiver's
+    // thread once the server replied, receiver must outlive the proxy.
+    template <typename Function>
+    inline void reset(QObject *receiver, Function finished)
+    {
+        invoke(Reset, QList<QVariant>(), receiver, finished);
+    }
+
+    // HAND-EDIT: not part of the generated interface. Servers without shared
+    // memory support reply with an error and payloads stay inline.
+    template <typename Function>
+    inline void setSharedBuffer(uint id, const QDBusUnixFileDescriptor &buffer, uint size, QObject *receiver, Function finished)
+    {
+        QList<QVariant> argumentList;
+        argumentList << QVariant::fromValue(id) << QVariant::fromValue(buffer) << QVariant::fromValue(size);
+        invoke(SetSharedBuffer, argumentList, receiver, finished);
+    }
+
+    // HAND-EDIT: not part of the generated interface. Servers that replace
+    // their state with every updateWidgetInformation() reply with an error,
+    // those that merge updates flagged "deltaUpdate" reply without one.
+    template <typename Function>
+    inline void enableDeltaUpdates(QObject *receiver, Function finished)
+    {
+        invoke(EnableDeltaUpdates, QList<QVariant>(), receiver, finished);
+    }
+
+private:
+    // HAND-EDIT: one prebuilt method call per method, only the arguments
+    // change between calls. Awaitable calls only take the name from theirs.
+    // Also indexes the statistics counters.
+    enum Method {
+        ActivateContext,
+        AppOrientationAboutToChange,
+        AppOrientationChanged,
+        EnableDeltaUpdates,
+        HideInputMethod,
+        MouseClickedOnPreedit,
+        ProcessKeyEvent,
+        RegisterAttributeExtension,
+        Reset,
+        SetCopyPasteState,
+        SetExtendedAttribute,
+        SetPreedit,
+        SetSharedBuffer,
+        ShowInputMethod,
+        UnregisterAttributeExtension,
+        UpdateWidgetInformation,
+        MethodCount
+    };
+
+    // The proxy lives on the D-Bus thread, calls are queued there so that
+    // marshalling doesn't hold up the caller and all calls stay in order
+    inline void send(Method method, const QList<QVariant> &argumentList)
+    {
+        QMetaObject::invokeMethod(this, [this, method, argumentList] {
+            QDBusMessage &message = m_messages[method];
+            MALIIT_TRACE_SCOPE(qPrintable(message.member()));
+            QMaliitStatistics::instance()->countOutbound(method);
+            if (QMaliitSessionRecorder *recorder = QMaliitSessionRecorder::instance())
+                recorder->recordOutbound(message.member(), argumentList);
+            // QDBusConnection::send() marshals right away and marks method calls
+            // as not expecting a reply, so the template can be reused
+            message.setArguments(argumentList);
+            connection().send(message);
+        }, Qt::QueuedConnection);
+    }
+
+    // HAND-EDIT: all awaitable calls go through here so that they can be instrumented
+    template <typename Function>
+    inline void invoke(Method method, const QList<QVariant> &argumentList, QObject *receiver, Function finished)
+    {
+        QMetaObject::invokeMethod(this, [this, method, argumentList, receiver, finished] {
+            const QString name = m_messages[method].member();
+            MALIIT_TRACE_SCOPE(qPrintable(name));
+            QMaliitStatistics::instance()->countOutbound(method);
+            if (QMaliitSessionRecorder *recorder = QMaliitSessionRecorder::instance())
+                recorder->recordOutbound(name, argumentList);
+            QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(asyncCallWithArgumentList(name, argumentList), this);
+            connect(watcher, &QDBusPendingCallWatcher::finished, this, [receiver, finished](QDBusPendingCallWatcher *call) {
+                call->deleteLater();
+                const bool ok = !call->isError();
+                QMetaObject::invokeMethod(receiver, [finished, ok] { finished(ok); }, Qt::QueuedConnection);
+            });
+        }, Qt::QueuedConnection);
+    }
+
+    QDBusMessage m_messages[MethodCount];
 };
 
 namespace com {
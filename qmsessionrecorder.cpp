@@ -0,0 +1,331 @@
+/* * This file is part of Maliit framework *
+ *
+ * Contact: maliit-discuss@lists.maliit.org
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * and appearing in the file LICENSE.LGPL included in the packaging
+ * of this file.
+ */
+
+#include "qmsessionrecorder.h"
+
+#include "qmnamespace.h"
+
+#include <QDBusVariant>
+#include <QDebug>
+#include <QMetaMethod>
+
+QDataStream &operator<<(QDataStream &stream, const Maliit::PreeditTextFormat &format)
+{
+    return stream << qint32(format.start) << qint32(format.length) << qint32(format.preeditFace);
+}
+
+QDataStream &operator>>(QDataStream &stream, Maliit::PreeditTextFormat &format)
+{
+    qint32 start, length, preeditFace;
+    stream >> start >> length >> preeditFace;
+    format = Maliit::PreeditTextFormat(start, length, Maliit::PreeditFace(preeditFace));
+    return stream;
+}
+
+QDataStream &operator<<(QDataStream &stream, const Maliit::KeyEventRecord &record)
+{
+    return stream << qint32(record.type) << qint32(record.key) << qint32(record.modifiers) << record.text
+                  << record.autoRepeat << qint32(record.count) << quint8(record.requestType);
+}
+
+QDataStream &operator>>(QDataStream &stream, Maliit::KeyEventRecord &record)
+{
+    qint32 type, key, modifiers, count;
+    quint8 requestType;
+    stream >> type >> key >> modifiers >> record.text >> record.autoRepeat >> count >> requestType;
+    record.type = type;
+    record.key = key;
+    record.modifiers = modifiers;
+    record.count = count;
+    record.requestType = Maliit::EventRequestType(requestType);
+    return stream;
+}
+
+namespace
+{
+    const qint64 FlushInterval = 1000000000; // ns, at most this much of a session is lost in a crash
+
+    // QDataStream only knows about the types registered in
+    // registerStreamOperators(), drop anything else. Variants and
+    // containers can hold anything, e.g. QDBusArgument, so their contents
+    // are checked too.
+    QVariant streamable(const QVariant &value)
+    {
+        const int type = value.userType();
+        if (type == qMetaTypeId<QDBusVariant>())
+            return streamable(value.value<QDBusVariant>().variant());
+        if (type == QMetaType::QVariantList) {
+            QVariantList list = value.toList();
+            for (QVariant &element : list)
+                element = streamable(element);
+            return list;
+        }
+        if (type == QMetaType::QVariantMap) {
+            QVariantMap map = value.toMap();
+            for (auto it = map.begin(); it != map.end(); ++it)
+                it.value() = streamable(it.value());
+            return map;
+        }
+        if (type == QMetaType::QVariantHash) {
+            QVariantHash hash = value.toHash();
+            for (auto it = hash.begin(); it != hash.end(); ++it)
+                it.value() = streamable(it.value());
+            return hash;
+        }
+        if (type == QMetaType::QObjectStar || type == QMetaType::VoidStar || type == QMetaType::Nullptr)
+            return QVariant();
+        if (type < QMetaType::User
+                || type == qMetaTypeId<QVector<Maliit::PreeditTextFormat> >()
+                || type == qMetaTypeId<QVector<Maliit::KeyEventRecord> >())
+            return value;
+        return QVariant();
+    }
+}
+
+Q_GLOBAL_STATIC(QMaliitSessionRecorder, sessionRecorder)
+
+QMaliitSessionRecorder::QMaliitSessionRecorder()
+    : m_lastFlush(0)
+{
+    const QString fileName = qEnvironmentVariable("MALIIT_RECORD_FILE");
+    if (fileName.isEmpty())
+        return;
+
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Maliit: cannot record the session to" << fileName << m_file.errorString();
+        return;
+    }
+
+    registerStreamOperators();
+    m_stream.setDevice(&m_file);
+    m_stream.setVersion(QDataStream::Qt_5_6);
+    m_stream << quint32(Magic) << quint16(Version);
+    m_clock.start();
+}
+
+QMaliitSessionRecorder::~QMaliitSessionRecorder()
+{
+    if (m_file.isOpen())
+        m_file.flush();
+}
+
+QMaliitSessionRecorder *QMaliitSessionRecorder::instance()
+{
+    QMaliitSessionRecorder *recorder = sessionRecorder();
+    return recorder && recorder->m_file.isOpen() ? recorder : nullptr;
+}
+
+void QMaliitSessionRecorder::registerStreamOperators()
+{
+    qRegisterMetaTypeStreamOperators<QVector<Maliit::PreeditTextFormat> >();
+    qRegisterMetaTypeStreamOperators<QVector<Maliit::KeyEventRecord> >();
+}
+
+void QMaliitSessionRecorder::recordInbound(const char *method, const QVariantList &arguments)
+{
+    record(InboundCall, QByteArray::fromRawData(method, int(qstrlen(method))), arguments);
+}
+
+void QMaliitSessionRecorder::recordOutbound(const QString &method, const QVariantList &arguments)
+{
+    record(OutboundCall, method.toLatin1(), arguments);
+}
+
+void QMaliitSessionRecorder::record(RecordType type, const QByteArray &method, const QVariantList &arguments)
+{
+    QVariantList values;
+    values.reserve(arguments.size());
+    for (const QVariant &argument : arguments)
+        values << streamable(argument);
+
+    QMutexLocker locker(&m_mutex);
+
+    auto id = m_methodIds.constFind(method);
+    if (id == m_methodIds.constEnd()) {
+        // Deep copy, inbound method names are raw data
+        id = m_methodIds.insert(QByteArray(method.constData(), method.size()), quint16(m_methodIds.size()));
+        m_stream << quint8(MethodDefinition) << id.value() << id.key();
+    }
+
+    const qint64 now = m_clock.nsecsElapsed();
+    m_stream << quint8(type) << id.value() << now << values;
+    // Writing through on every call would put a syscall on the input path.
+    // Flush now and then instead, so that a crash loses little of the
+    // session, and on exit.
+    if (now - m_lastFlush >= FlushInterval) {
+        m_file.flush();
+        m_lastFlush = now;
+    }
+}
+
+QMaliitSessionReplayer *QMaliitSessionReplayer::create(QObject *parent, bool debug)
+{
+    const QString fileName = qEnvironmentVariable("MALIIT_REPLAY_FILE");
+    if (fileName.isEmpty())
+        return nullptr;
+
+    const bool originalTiming = qEnvironmentVariable("MALIIT_REPLAY_TIMING") == QLatin1String("original");
+    QMaliitSessionReplayer *replayer = new QMaliitSessionReplayer(originalTiming, debug, parent);
+    if (!replayer->load(fileName)) {
+        delete replayer;
+        return nullptr;
+    }
+    return replayer;
+}
+
+QMaliitSessionReplayer::QMaliitSessionReplayer(bool originalTiming, bool debug, QObject *parent)
+    : QObject(parent)
+    , m_next(0)
+    , m_originalTiming(originalTiming)
+    , m_debug(debug)
+    , m_target(nullptr)
+    , m_sinkConnection(QString())
+{
+    m_timer.setSingleShot(true);
+    connect(&m_timer, &QTimer::timeout, this, &QMaliitSessionReplayer::dispatchNext);
+
+    // Keeps the plugin's connection open
+    connect(&m_sink, &QDBusServer::newConnection, this, [this](const QDBusConnection &connection) {
+        m_sinkConnection = connection;
+    });
+}
+
+QMaliitSessionReplayer::~QMaliitSessionReplayer()
+{
+    if (m_sinkConnection.isConnected())
+        QDBusConnection::disconnectFromPeer(m_sinkConnection.name());
+}
+
+QString QMaliitSessionReplayer::sinkAddress() const
+{
+    return m_sink.address();
+}
+
+bool QMaliitSessionReplayer::load(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Maliit: cannot replay" << fileName << file.errorString();
+        return false;
+    }
+
+    QMaliitSessionRecorder::registerStreamOperators();
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_6);
+
+    quint32 magic;
+    quint16 version;
+    stream >> magic >> version;
+    if (magic != QMaliitSessionRecorder::Magic || version != QMaliitSessionRecorder::Version) {
+        qWarning() << "Maliit: not a recorded session:" << fileName;
+        return false;
+    }
+
+    QHash<quint16, QByteArray> methods;
+    while (!stream.atEnd() && stream.status() == QDataStream::Ok) {
+        quint8 type;
+        quint16 id;
+        stream >> type >> id;
+
+        if (type == QMaliitSessionRecorder::MethodDefinition) {
+            stream >> methods[id];
+            continue;
+        }
+
+        Call call;
+        stream >> call.timestamp >> call.arguments;
+        // Only the server's calls are replayed, the plugin makes its own
+        if (type == QMaliitSessionRecorder::InboundCall) {
+            call.method = methods.value(id);
+            m_calls.append(call);
+        }
+    }
+
+    if (stream.status() != QDataStream::Ok)
+        qWarning() << "Maliit: recorded session is truncated:" << fileName;
+    return true;
+}
+
+void QMaliitSessionReplayer::start(QObject *target)
+{
+    if (m_target)
+        return;
+
+    if (m_debug)
+        qDebug() << "Maliit: replaying" << m_calls.size() << "recorded calls";
+    m_target = target;
+    m_clock.start();
+    m_timer.start(0);
+}
+
+void QMaliitSessionReplayer::dispatchNext()
+{
+    if (m_next >= m_calls.size()) {
+        if (m_debug)
+            qDebug() << "Maliit: replayed" << m_calls.size() << "calls in" << m_clock.elapsed() << "ms";
+        return;
+    }
+
+    const Call &call = m_calls.at(m_next++);
+    if (!dispatch(call))
+        qWarning() << "Maliit: cannot replay call to" << call.method;
+
+    if (m_next >= m_calls.size()) {
+        m_timer.start(0);
+        return;
+    }
+
+    // Let the application process each call before the next one
+    int delay = 0;
+    if (m_originalTiming)
+        delay = int((m_calls.at(m_next).timestamp - call.timestamp) / 1000000);
+    m_timer.start(qMax(delay, 0));
+}
+
+bool QMaliitSessionReplayer::dispatch(const Call &call)
+{
+    const QMetaObject *metaObject = m_target->metaObject();
+    for (int i = 0; i < metaObject->methodCount(); ++i) {
+        const QMetaMethod method = metaObject->method(i);
+        if (method.name() != call.method)
+            continue;
+
+        // Methods with out parameters only answer the server's questions,
+        // they are recorded without arguments and have nothing to replay
+        for (int p = 0; p < method.parameterCount(); ++p) {
+            if (method.parameterType(p) == QMetaType::UnknownType)
+                return true;
+        }
+
+        if (method.parameterCount() != call.arguments.size() || method.parameterCount() > 10)
+            continue;
+
+        QVariantList arguments = call.arguments;
+        QGenericArgument genericArguments[10];
+        for (int p = 0; p < method.parameterCount(); ++p) {
+            const int type = method.parameterType(p);
+            QVariant &argument = arguments[p];
+            if (type == qMetaTypeId<QDBusVariant>())
+                argument = QVariant::fromValue(QDBusVariant(argument));
+            else if (argument.userType() != type && !argument.convert(type))
+                return false;
+            genericArguments[p] = QGenericArgument(QMetaType::typeName(type), argument.constData());
+        }
+
+        return method.invoke(m_target, Qt::DirectConnection,
+                             genericArguments[0], genericArguments[1], genericArguments[2],
+                             genericArguments[3], genericArguments[4], genericArguments[5],
+                             genericArguments[6], genericArguments[7], genericArguments[8],
+                             genericArguments[9]);
+    }
+    return false;
+}
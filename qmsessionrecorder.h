@@ -0,0 +1,123 @@
+/* * This file is part of Maliit framework *
+ *
+ * Contact: maliit-discuss@lists.maliit.org
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * and appearing in the file LICENSE.LGPL included in the packaging
+ * of this file.
+ */
+
+#ifndef QMSESSIONRECORDER_H
+#define QMSESSIONRECORDER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QTimer>
+#include <QVariant>
+#include <QVector>
+#include <QtDBus/QDBusConnection>
+#include <QtDBus/QDBusServer>
+
+/*
+ * Writes every call between the plugin and the input method server to the
+ * file named by MALIIT_RECORD_FILE, with a timestamp.
+ *
+ * The file is a QDataStream: a header (magic, version) followed by records
+ * starting with a RecordType. Method names are written once in a
+ * MethodDefinition record and referred to by id afterwards.
+ */
+class QMaliitSessionRecorder
+{
+public:
+    enum RecordType {
+        MethodDefinition, // quint16 id, QByteArray name
+        InboundCall,      // quint16 method id, qint64 ns since start, QVariantList arguments
+        OutboundCall      // same as InboundCall
+    };
+
+    enum {
+        Magic = 0x4d4c5452, // "MLTR"
+        Version = 1
+    };
+
+    QMaliitSessionRecorder();
+    ~QMaliitSessionRecorder();
+
+    //! Returns null unless a session is being recorded
+    static QMaliitSessionRecorder *instance();
+
+    static void registerStreamOperators();
+
+    void recordInbound(const char *method, const QVariantList &arguments);
+    void recordOutbound(const QString &method, const QVariantList &arguments);
+
+private:
+    void record(RecordType type, const QByteArray &method, const QVariantList &arguments);
+
+    QMutex m_mutex;
+    QFile m_file;
+    QDataStream m_stream;
+    QElapsedTimer m_clock;
+    qint64 m_lastFlush; // ns on m_clock
+    QHash<QByteArray, quint16> m_methodIds;
+};
+
+/*
+ * Feeds the inbound calls of a recorded session back into the input context
+ * when MALIIT_REPLAY_FILE is set, instead of connecting to a server. Calls
+ * are dispatched as fast as the event loop allows, or with the recorded
+ * spacing when MALIIT_REPLAY_TIMING=original.
+ *
+ * The plugin connects to a sink in place of the server, so that its calls
+ * are still marshalled and sent. The sink has no objects and replies with
+ * errors where a reply is expected, so the plugin behaves as with a stock
+ * server.
+ */
+class QMaliitSessionReplayer : public QObject
+{
+    Q_OBJECT
+
+public:
+    //! Returns null unless a session replay was asked for
+    static QMaliitSessionReplayer *create(QObject *parent, bool debug = false);
+    ~QMaliitSessionReplayer();
+
+    //! Where the plugin connects to instead of the server
+    QString sinkAddress() const;
+
+    //! Starts dispatching to the slots of \a target, once
+    void start(QObject *target);
+
+private Q_SLOTS:
+    void dispatchNext();
+
+private:
+    struct Call {
+        qint64 timestamp;
+        QByteArray method;
+        QVariantList arguments;
+    };
+
+    QMaliitSessionReplayer(bool originalTiming, bool debug, QObject *parent);
+    bool load(const QString &fileName);
+    bool dispatch(const Call &call);
+
+    QVector<Call> m_calls;
+    int m_next;
+    bool m_originalTiming;
+    bool m_debug;
+    QObject *m_target;
+    QTimer m_timer;
+    QElapsedTimer m_clock;
+    QDBusServer m_sink;
+    QDBusConnection m_sinkConnection;
+};
+
+#endif
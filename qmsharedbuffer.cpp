@@ -0,0 +1,99 @@
+/* * This file is part of Maliit framework *
+ *
+ * Contact: maliit-discuss@lists.maliit.org
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * and appearing in the file LICENSE.LGPL included in the packaging
+ * of this file.
+ */
+
+#include "qmsharedbuffer.h"
+
+#include <QAtomicInteger>
+#include <QDebug>
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace
+{
+    QBasicAtomicInteger<quint64> *releasedPosition(uchar *buffer)
+    {
+        return reinterpret_cast<QBasicAtomicInteger<quint64> *>(buffer);
+    }
+}
+
+QMaliitSharedBuffer::QMaliitSharedBuffer(quint32 id, quint32 size)
+    : m_id(id)
+    , m_size(size & ~quint32(7))
+    , m_written(0)
+    , m_fd(-1)
+    , m_data(nullptr)
+{
+    m_fd = memfd_create("maliit-im-payload", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (m_fd < 0) {
+        qWarning() << "QMaliitSharedBuffer: memfd_create failed:" << strerror(errno);
+        return;
+    }
+
+    if (m_size <= HeaderSize || ftruncate(m_fd, m_size) < 0) {
+        qWarning() << "QMaliitSharedBuffer: ftruncate failed:" << strerror(errno);
+        return;
+    }
+
+    // The server maps the buffer too, make sure it can't be resized under it
+    fcntl(m_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+
+    void *data = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (data == MAP_FAILED) {
+        qWarning() << "QMaliitSharedBuffer: mmap failed:" << strerror(errno);
+        return;
+    }
+    m_data = static_cast<uchar *>(data);
+}
+
+QMaliitSharedBuffer::~QMaliitSharedBuffer()
+{
+    if (m_data)
+        munmap(m_data, m_size);
+    if (m_fd >= 0)
+        close(m_fd);
+}
+
+bool QMaliitSharedBuffer::write(const void *data, quint32 length, quint32 *offset, quint64 *end)
+{
+    if (!m_data)
+        return false;
+
+    // Payloads never wrap, one that would starts over at the beginning of
+    // the ring and the rest of the ring counts as used
+    const quint32 capacity = m_size - HeaderSize;
+    quint64 start = m_written;
+    quint32 position = quint32(start % capacity);
+    if (quint64(position) + length > capacity) {
+        start += capacity - position;
+        position = 0;
+    }
+    // Keep payloads 8 byte aligned
+    const quint64 payloadEnd = (start + length + 7) & ~quint64(7);
+
+    // The ring is full up to what the server hasn't copied out yet
+    if (payloadEnd - releasedPosition(m_data)->loadAcquire() > capacity)
+        return false;
+
+    memcpy(m_data + HeaderSize + position, data, length);
+    m_written = payloadEnd;
+    *offset = HeaderSize + position;
+    *end = payloadEnd;
+    return true;
+}
+
+void QMaliitSharedBuffer::release(uchar *buffer, quint64 end)
+{
+    releasedPosition(buffer)->storeRelease(end);
+}
@@ -0,0 +1,63 @@
+/* * This file is part of Maliit framework *
+ *
+ * Contact: maliit-discuss@lists.maliit.org
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * and appearing in the file LICENSE.LGPL included in the packaging
+ * of this file.
+ */
+
+#ifndef QMSHAREDBUFFER_H
+#define QMSHAREDBUFFER_H
+
+#include <QtGlobal>
+
+/*
+ * Ring of shared memory handed to the input method server once per
+ * connection. Bulky payloads are copied into it and the D-Bus message only
+ * carries the buffer id, offset, length and end position.
+ *
+ * The buffer starts with a header holding the position up to which the
+ * server has copied payloads out, a 64 bit counter at offset 0. Positions
+ * count the bytes ever used in the ring, so they only grow. Once the server
+ * copied a payload out it stores the payload's end position there with
+ * release() or an equivalent atomic store. The plugin never overwrites what
+ * the server has not released yet, payloads that don't fit are sent inline.
+ */
+class QMaliitSharedBuffer
+{
+public:
+    enum {
+        DefaultSize = 4 * 1024 * 1024,
+        HeaderSize = 64 // released position, padded to a cache line
+    };
+
+    explicit QMaliitSharedBuffer(quint32 id, quint32 size = DefaultSize);
+    ~QMaliitSharedBuffer();
+
+    bool isValid() const { return m_data != nullptr; }
+    quint32 id() const { return m_id; }
+    quint32 size() const { return m_size; }
+    int fileDescriptor() const { return m_fd; }
+
+    //! Copies \a length bytes into the ring and returns their \a offset in
+    //! the buffer and the \a end position the server releases them with.
+    //! Returns false if they don't fit next to what is not released yet.
+    bool write(const void *data, quint32 length, quint32 *offset, quint64 *end);
+
+    //! Server side: payloads up to \a end in the mapped \a buffer were copied out
+    static void release(uchar *buffer, quint64 end);
+
+private:
+    Q_DISABLE_COPY(QMaliitSharedBuffer)
+
+    quint32 m_id;
+    quint32 m_size;
+    quint64 m_written; // end position of the last payload
+    int m_fd;
+    uchar *m_data;
+};
+
+#endif
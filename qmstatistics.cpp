@@ -0,0 +1,187 @@
+/* * This file is part of Maliit framework *
+ *
+ * Contact: maliit-discuss@lists.maliit.org
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * and appearing in the file LICENSE.LGPL included in the packaging
+ * of this file.
+ */
+
+#include "qmstatistics.h"
+
+#include <QDBusConnection>
+#include <QRect>
+#include <QStringList>
+#include <QTextStream>
+#include <QtAlgorithms>
+
+#include <cstring>
+
+namespace
+{
+    const char * const StatisticsPath = "/org/maliit/InputContext/Statistics";
+
+    const char * const HistogramNames[] = {
+        "inbound dispatch (us)",
+        "focus object events (us)",
+        "hardware key response (us)",
+        "updateWidgetInformation size (bytes)"
+    };
+
+    qint64 stringSize(const QString &string)
+    {
+        // Length, text assumed to be mostly ASCII and the terminating nul
+        return 4 + string.size() + 1;
+    }
+
+    quint64 percentile(const quint64 *buckets, int bucketCount, quint64 count, int percent)
+    {
+        const quint64 wanted = (count * percent + 99) / 100;
+        quint64 seen = 0;
+        for (int i = 0; i < bucketCount; ++i) {
+            seen += buckets[i];
+            if (seen >= wanted)
+                return quint64(1) << i;
+        }
+        return quint64(1) << (bucketCount - 1);
+    }
+}
+
+Q_GLOBAL_STATIC(QMaliitStatistics, statistics)
+
+QMaliitStatistics::QMaliitStatistics(QObject *parent)
+    : QObject(parent)
+{
+    memset(m_histograms, 0, sizeof(m_histograms));
+}
+
+QMaliitStatistics *QMaliitStatistics::instance()
+{
+    return statistics();
+}
+
+void QMaliitStatistics::registerOnSessionBus()
+{
+    static bool registered = false;
+    if (registered)
+        return;
+    registered = true;
+
+    QDBusConnection::sessionBus().registerObject(QLatin1String(StatisticsPath), instance(),
+                                                 QDBusConnection::ExportAllSlots);
+}
+
+void QMaliitStatistics::setMethodNames(Direction direction, const QStringList &names)
+{
+    Q_ASSERT(names.size() <= MaxMethods);
+    QMutexLocker locker(&m_mutex);
+    m_methodNames[direction] = names;
+}
+
+void QMaliitStatistics::countInbound(int method)
+{
+    Q_ASSERT(method >= 0 && method < MaxMethods);
+    m_calls[Inbound][method].fetchAndAddRelaxed(1);
+}
+
+void QMaliitStatistics::countOutbound(int method)
+{
+    Q_ASSERT(method >= 0 && method < MaxMethods);
+    m_calls[Outbound][method].fetchAndAddRelaxed(1);
+}
+
+void QMaliitStatistics::record(Histogram histogram, qint64 value)
+{
+    const quint64 v = qMax<qint64>(value, 0);
+    int bucket = v ? 64 - qCountLeadingZeroBits(v) : 0;
+    bucket = qMin<int>(bucket, BucketCount - 1);
+
+    QMutexLocker locker(&m_mutex);
+    Data &data = m_histograms[histogram];
+    ++data.buckets[bucket];
+    ++data.count;
+    data.sum += v;
+    data.max = qMax(data.max, v);
+}
+
+qint64 QMaliitStatistics::marshalledSize(const QVariant &value)
+{
+    // Signature of the variant
+    qint64 size = 3;
+
+    switch (value.userType()) {
+    case QMetaType::Bool:
+    case QMetaType::Int:
+    case QMetaType::UInt:
+        return size + 4;
+    case QMetaType::LongLong:
+    case QMetaType::ULongLong:
+    case QMetaType::Double:
+        return size + 8;
+    case QMetaType::QString:
+        return size + stringSize(value.toString());
+    case QMetaType::QRect:
+        return size + 16;
+    case QMetaType::QVariantList: {
+        size += 4;
+        const QVariantList list = value.toList();
+        for (const QVariant &item : list)
+            size += marshalledSize(item);
+        return size;
+    }
+    case QMetaType::QVariantMap: {
+        size += 4;
+        const QVariantMap map = value.toMap();
+        for (auto it = map.constBegin(); it != map.constEnd(); ++it)
+            size += 8 + stringSize(it.key()) + marshalledSize(it.value());
+        return size;
+    }
+    default:
+        return size + 8;
+    }
+}
+
+QString QMaliitStatistics::dump() const
+{
+    QString result;
+    QTextStream stream(&result);
+
+    QMutexLocker locker(&m_mutex);
+
+    for (int i = 0; i < HistogramCount; ++i) {
+        const Data &data = m_histograms[i];
+        stream << HistogramNames[i] << ": count " << data.count;
+        if (data.count) {
+            stream << ", mean " << data.sum / data.count
+                   << ", p50 < " << percentile(data.buckets, BucketCount, data.count, 50)
+                   << ", p90 < " << percentile(data.buckets, BucketCount, data.count, 90)
+                   << ", p99 < " << percentile(data.buckets, BucketCount, data.count, 99)
+                   << ", max " << data.max;
+        }
+        stream << '\n';
+    }
+
+    const char * const directions[] = { "inbound", "outbound" };
+    for (int i = 0; i < DirectionCount; ++i) {
+        const QStringList &methods = m_methodNames[i];
+        for (int method = 0; method < methods.size(); ++method) {
+            if (const quint32 count = m_calls[i][method].loadAcquire())
+                stream << directions[i] << ' ' << methods.at(method) << ": " << count << '\n';
+        }
+    }
+
+    stream.flush();
+    return result;
+}
+
+void QMaliitStatistics::reset()
+{
+    QMutexLocker locker(&m_mutex);
+    memset(m_histograms, 0, sizeof(m_histograms));
+    for (int i = 0; i < DirectionCount; ++i) {
+        for (int method = 0; method < MaxMethods; ++method)
+            m_calls[i][method].storeRelease(0);
+    }
+}
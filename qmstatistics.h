@@ -0,0 +1,115 @@
+/* * This file is part of Maliit framework *
+ *
+ * Contact: maliit-discuss@lists.maliit.org
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * and appearing in the file LICENSE.LGPL included in the packaging
+ * of this file.
+ */
+
+#ifndef QMSTATISTICS_H
+#define QMSTATISTICS_H
+
+#include <QObject>
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+
+/*
+ * Call counters and latency histograms for the plugin's IPC paths.
+ *
+ * Always collected, the numbers can be read with
+ *   dbus-send --session --print-reply --dest=<unique name of the application>
+ *       /org/maliit/InputContext/Statistics org.maliit.InputContext.Statistics.dump
+ */
+class QMaliitStatistics : public QObject
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.maliit.InputContext.Statistics")
+
+public:
+    enum Histogram {
+        InboundDispatch,   //!< us from the D-Bus thread receiving an input call until the application handled it
+        FocusObjectEvent,  //!< us spent in the focus object's event handlers
+        KeyResponse,       //!< us from forwarding a hardware key until the server responded
+        StateUpdateSize,   //!< approximate bytes marshalled per updateWidgetInformation
+        HistogramCount
+    };
+
+    enum Direction {
+        Inbound,
+        Outbound,
+        DirectionCount
+    };
+
+    //! Records the time until it goes out of scope in a histogram
+    class Timer
+    {
+    public:
+        explicit Timer(Histogram histogram)
+            : m_histogram(histogram)
+        {
+            m_timer.start();
+        }
+
+        //! Counts from when \a started was started instead, e.g. on another thread
+        Timer(Histogram histogram, const QElapsedTimer &started)
+            : m_histogram(histogram)
+            , m_timer(started)
+        {
+        }
+
+        ~Timer()
+        {
+            QMaliitStatistics::instance()->record(m_histogram, m_timer.nsecsElapsed() / 1000);
+        }
+
+    private:
+        Histogram m_histogram;
+        QElapsedTimer m_timer;
+    };
+
+    explicit QMaliitStatistics(QObject *parent = nullptr);
+
+    static QMaliitStatistics *instance();
+    static void registerOnSessionBus();
+
+    //! Names the counters of \a direction in dump(), counter n counts \a names[n]
+    void setMethodNames(Direction direction, const QStringList &names);
+    //! Lock-free, \a method is the caller's own method index, see setMethodNames()
+    void countInbound(int method);
+    void countOutbound(int method);
+    void record(Histogram histogram, qint64 value);
+
+    //! Approximate size of \a value when marshalled as a D-Bus variant
+    static qint64 marshalledSize(const QVariant &value);
+
+public Q_SLOTS:
+    QString dump() const;
+    void reset();
+
+private:
+    enum {
+        BucketCount = 32, // bucket n counts values below 2^n
+        MaxMethods = 32
+    };
+
+    struct Data {
+        quint64 buckets[BucketCount];
+        quint64 count;
+        quint64 sum;
+        quint64 max;
+    };
+
+    mutable QMutex m_mutex;
+    Data m_histograms[HistogramCount];
+    QStringList m_methodNames[DirectionCount];
+    QAtomicInteger<quint32> m_calls[DirectionCount][MaxMethods];
+};
+
+#endif
@@ -0,0 +1,61 @@
+/* * This file is part of Maliit framework *
+ *
+ * Contact: maliit-discuss@lists.maliit.org
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * and appearing in the file LICENSE.LGPL included in the packaging
+ * of this file.
+ */
+
+#include "qmtrace.h"
+
+#include <QtGlobal>
+
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+    int traceMarker()
+    {
+        // Tracing is off when the marker can't be opened, events are then dropped
+        static const int fd = [] {
+            int fd = open("/sys/kernel/tracing/trace_marker", O_WRONLY | O_CLOEXEC);
+            if (fd < 0)
+                fd = open("/sys/kernel/debug/tracing/trace_marker", O_WRONLY | O_CLOEXEC);
+            return fd;
+        }();
+        return fd;
+    }
+
+    void writeMarker(const char *buffer, int length)
+    {
+        if (length <= 0)
+            return;
+        const ssize_t written = write(traceMarker(), buffer, length);
+        Q_UNUSED(written);
+    }
+}
+
+void QMaliitTrace::begin(const char *name)
+{
+    if (traceMarker() < 0)
+        return;
+
+    char buffer[128];
+    const int length = snprintf(buffer, sizeof(buffer), "B|%d|maliit:%s", getpid(), name);
+    writeMarker(buffer, qMin<int>(length, sizeof(buffer) - 1));
+}
+
+void QMaliitTrace::end()
+{
+    if (traceMarker() < 0)
+        return;
+
+    char buffer[32];
+    const int length = snprintf(buffer, sizeof(buffer), "E|%d", getpid());
+    writeMarker(buffer, qMin<int>(length, sizeof(buffer) - 1));
+}
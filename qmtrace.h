@@ -0,0 +1,47 @@
+/* * This file is part of Maliit framework *
+ *
+ * Contact: maliit-discuss@lists.maliit.org
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * and appearing in the file LICENSE.LGPL included in the packaging
+ * of this file.
+ */
+
+#ifndef QMTRACE_H
+#define QMTRACE_H
+
+/*
+ * Begin/end trace events written to the ftrace marker, in the format that
+ * systrace and Perfetto understand, so that input method activity shows up
+ * next to frame timing in system wide traces.
+ *
+ * Built with CONFIG+=maliit_tracing only, otherwise the macro expands to
+ * nothing and its argument is not evaluated.
+ */
+#ifdef MALIIT_TRACING
+
+class QMaliitTrace
+{
+public:
+    static void begin(const char *name);
+    static void end();
+
+    class Scope
+    {
+    public:
+        explicit Scope(const char *name) { begin(name); }
+        ~Scope() { end(); }
+    };
+};
+
+#define MALIIT_TRACE_SCOPE(name) QMaliitTrace::Scope maliitTraceScope(name)
+
+#else
+
+#define MALIIT_TRACE_SCOPE(name)
+
+#endif
+
+#endif
@@ -0,0 +1,5 @@
+CONFIG += testcase
+TARGET = tst_inputcontext
+
+include(../../common/common.pri)
+SOURCES += tst_inputcontext.cpp
@@ -0,0 +1,586 @@
+/* * This file is part of Maliit framework *
+ *
+ * Contact: maliit-discuss@lists.maliit.org
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * and appearing in the file LICENSE.LGPL included in the packaging
+ * of this file.
+ */
+
+#include "maliittest.h"
+#include "mockserver.h"
+#include "qmaliitplatforminputcontext.h"
+
+// Answers the bounded queries the way QTextEdit does: ignoring the
+// requested length and reaching into the previous block, while the cursor
+// position stays relative to the cursor's block
+class BlockInputWindow : public TestInputWindow
+{
+    Q_OBJECT
+
+public:
+    Q_INVOKABLE QVariant inputMethodQuery(Qt::InputMethodQuery query, const QVariant &argument) const
+    {
+        Q_UNUSED(argument);
+        switch (query) {
+        case Qt::ImTextBeforeCursor:
+            return QString(QStringLiteral("previous block\n") + text.left(cursorPosition));
+        case Qt::ImTextAfterCursor:
+            return text.mid(cursorPosition);
+        default:
+            return queryValue(query);
+        }
+    }
+};
+
+// Counts how often the selected text is asked for
+class SelectionCountingWindow : public TestInputWindow
+{
+    Q_OBJECT
+
+public:
+    SelectionCountingWindow() : selectionQueries(0) {}
+
+    mutable int selectionQueries;
+
+protected:
+    QVariant queryValue(Qt::InputMethodQuery query) const override
+    {
+        if (query == Qt::ImCurrentSelection)
+            ++selectionQueries;
+        return TestInputWindow::queryValue(query);
+    }
+};
+
+class tst_InputContext : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void init();
+    void cleanup();
+
+    void connectsAndSendsState();
+    void lookupOnSessionBus();
+    void fullSnapshotsForStockServer();
+    void deltaUpdatesOnceConfirmed();
+    void commitString();
+    void updatePreedit();
+    void keyEvent();
+    void staleInputAfterReset();
+    void selection();
+    void replyAfterFlushedState();
+    void selectionFromPositions();
+    void surroundingTextWindow();
+    void attributeExtensions();
+    void reconnectReplaysState();
+    void hideDebounce();
+    void orientationDebounce();
+    void windowStateCache();
+    void keyEvents();
+    void redirectKeys();
+    void preeditDeduplication();
+    void keyboardAnimation();
+
+private:
+    bool startContext(bool sessionBus = false);
+    void moveCursor();
+    bool waitForDeltaUpdates();
+
+    QScopedPointer<MockServer> m_server;
+    QScopedPointer<QMaliitPlatformInputContext> m_context;
+    QScopedPointer<TestInputWindow> m_window;
+};
+
+void tst_InputContext::init()
+{
+    m_window.reset(new TestInputWindow);
+    m_window->text = QStringLiteral("hello world");
+    m_window->cursorPosition = 5;
+    QVERIFY(m_window->activate());
+    m_server.reset(new MockServer);
+}
+
+void tst_InputContext::cleanup()
+{
+    // The context goes first, the server going away would make it reconnect
+    m_context.reset();
+    m_server.reset();
+    m_window.reset();
+    qunsetenv("MALIIT_SERVER_ADDRESS");
+    qunsetenv("MALIIT_SURROUNDING_TEXT_WINDOW");
+}
+
+bool tst_InputContext::startContext(bool sessionBus)
+{
+    m_context.reset(startInputContext(m_server.data(), sessionBus));
+    return !m_context.isNull();
+}
+
+void tst_InputContext::moveCursor()
+{
+    m_window->cursorPosition = (m_window->cursorPosition + 1) % (m_window->text.length() + 1);
+    m_context->update(Qt::ImCursorPosition);
+}
+
+// Deltas only start once the server's confirmation is back
+bool tst_InputContext::waitForDeltaUpdates()
+{
+    return spinUntil([this] {
+        moveCursor();
+        return m_server->widgetUpdates.last().contains(QStringLiteral("deltaUpdate"));
+    });
+}
+
+void tst_InputContext::connectsAndSendsState()
+{
+    QVERIFY(startContext());
+    QVERIFY(m_server->isConnected());
+    QCOMPARE(m_server->callCount(QStringLiteral("activateContext")), 1);
+    QCOMPARE(m_server->widgetState.value(QStringLiteral("focusState")).toBool(), true);
+    QCOMPARE(m_server->widgetState.value(QStringLiteral("surroundingText")).toString(), m_window->text);
+    QCOMPARE(m_server->widgetState.value(QStringLiteral("cursorPosition")).toInt(), 5);
+    QCOMPARE(m_server->focusChanges.first(), true);
+}
+
+void tst_InputContext::lookupOnSessionBus()
+{
+    if (!m_server->publishOnSessionBus())
+        QSKIP("No session bus, or org.maliit.server is taken");
+
+    QVERIFY(startContext(/*sessionBus*/true));
+    QVERIFY(m_server->isConnected());
+}
+
+void tst_InputContext::fullSnapshotsForStockServer()
+{
+    QVERIFY(startContext());
+    QVERIFY(spinUntil([this] { return m_server->callCount(QStringLiteral("enableDeltaUpdates")) == 1; }));
+
+    // Updates keep coming as full snapshots after the server declined
+    for (int i = 0; i < 3; ++i) {
+        const int updates = m_server->widgetUpdates.size();
+        moveCursor();
+        QVERIFY(spinUntil([this, updates] { return m_server->widgetUpdates.size() > updates; }));
+        const QVariantMap update = m_server->widgetUpdates.last();
+        QVERIFY(!update.contains(QStringLiteral("deltaUpdate")));
+        QCOMPARE(update.value(QStringLiteral("surroundingText")).toString(), m_window->text);
+        QCOMPARE(update.value(QStringLiteral("cursorPosition")).toInt(), m_window->cursorPosition);
+    }
+}
+
+void tst_InputContext::deltaUpdatesOnceConfirmed()
+{
+    m_server->mergesDeltaUpdates = true;
+    QVERIFY(startContext());
+    QVERIFY(waitForDeltaUpdates());
+    QVERIFY(spinUntil([this] {
+        return m_server->widgetState.value(QStringLiteral("cursorPosition")).toInt() == m_window->cursorPosition;
+    }));
+
+    const QVariantMap delta = m_server->widgetUpdates.last();
+    QVERIFY(!delta.contains(QStringLiteral("surroundingText")));
+    // Query updates are no focus changes and leave focusState alone
+    QVERIFY(!delta.contains(QStringLiteral("focusState")));
+    QCOMPARE(m_server->focusChanges.last(), false);
+    QCOMPARE(m_server->widgetState.value(QStringLiteral("focusState")).toBool(), true);
+    QCOMPARE(m_server->widgetState.value(QStringLiteral("surroundingText")).toString(), m_window->text);
+}
+
+void tst_InputContext::commitString()
+{
+    QVERIFY(startContext());
+    m_server->commitString(QStringLiteral("hello"));
+    QTRY_COMPARE(m_window->commits, 1);
+    QCOMPARE(m_window->lastCommit, QStringLiteral("hello"));
+}
+
+void tst_InputContext::updatePreedit()
+{
+    QVERIFY(startContext());
+    QVector<Maliit::PreeditTextFormat> formats;
+    formats << Maliit::PreeditTextFormat(0, 2, Maliit::PreeditDefault)
+            << Maliit::PreeditTextFormat(2, 1, Maliit::PreeditActive);
+    m_server->updatePreedit(QStringLiteral("abc"), formats, 3);
+    QTRY_COMPARE(m_window->preedit, QStringLiteral("abc"));
+    // Both formats and the cursor
+    QCOMPARE(m_window->preeditAttributes, 3);
+}
+
+void tst_InputContext::keyEvent()
+{
+    QVERIFY(startContext());
+    m_server->keyEvent(QEvent::KeyPress, Qt::Key_A, QStringLiteral("a"));
+    m_server->keyEvent(QEvent::KeyRelease, Qt::Key_A, QStringLiteral("a"));
+    QTRY_COMPARE(m_window->keyReleases, 1);
+    QCOMPARE(m_window->keyPresses, 1);
+}
+
+void tst_InputContext::staleInputAfterReset()
+{
+    QVERIFY(startContext());
+    QVector<Maliit::PreeditTextFormat> formats;
+    formats << Maliit::PreeditTextFormat(0, 3, Maliit::PreeditDefault);
+    m_server->updatePreedit(QStringLiteral("abc"), formats, 3);
+    QTRY_COMPARE(m_window->preedit, QStringLiteral("abc"));
+
+    // The preedit is committed right away, without waiting for the server
+    m_server->delaysResetReplies = true;
+    m_context->reset();
+    QCOMPARE(m_window->commits, 1);
+    QCOMPARE(m_window->lastCommit, QStringLiteral("abc"));
+    QVERIFY(spinUntil([this] { return m_server->callCount(QStringLiteral("reset")) == 1; }));
+
+    // What the server sent before it got to the reset is dropped, key
+    // events aren't and tell when the rest went through
+    m_server->updatePreedit(QStringLiteral("stale"), formats, 5);
+    m_server->commitString(QStringLiteral("stale"));
+    m_server->keyEvent(QEvent::KeyRelease, Qt::Key_A, QStringLiteral("a"));
+    QTRY_COMPARE(m_window->keyReleases, 1);
+    QVERIFY(m_window->preedit.isEmpty());
+    QCOMPARE(m_window->commits, 1);
+    QCOMPARE(m_window->lastCommit, QStringLiteral("abc"));
+
+    // Once the reset is acknowledged input comes through again
+    m_server->replyToResets();
+    m_server->updatePreedit(QStringLiteral("fresh"), formats, 5);
+    QTRY_COMPARE(m_window->preedit, QStringLiteral("fresh"));
+}
+
+void tst_InputContext::selection()
+{
+    QVERIFY(startContext());
+    m_window->anchorPosition = 0;
+    m_context->update(Qt::ImAnchorPosition);
+
+    // Answered from the GUI thread, with the D-Bus thread's reply delayed
+    QDBusPendingReply<bool, QString> reply = m_server->asyncCall(QStringLiteral("selection"));
+    QVERIFY(spinUntil([&reply] { return reply.isFinished(); }));
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>(), true);
+    QCOMPARE(reply.argumentAt<1>(), QStringLiteral("hello"));
+}
+
+void tst_InputContext::replyAfterFlushedState()
+{
+    m_window->anchorPosition = m_window->cursorPosition;
+    QVERIFY(startContext());
+    QVERIFY(!m_server->widgetState.value(QStringLiteral("hasSelection")).toBool());
+
+    // Let the call wait on the GUI thread, then make a selection that is
+    // still being coalesced when it is answered. Posted calls run before
+    // the update timer, so the answer flushes the selection first.
+    QDBusPendingCallWatcher watcher(m_server->asyncCall(QStringLiteral("selection")));
+    QTest::qSleep(100);
+    m_window->anchorPosition = 0;
+    m_context->update(Qt::ImAnchorPosition);
+
+    // The server has the state the answer is based on by the time it arrives
+    bool answered = false;
+    bool stateFirst = false;
+    connect(&watcher, &QDBusPendingCallWatcher::finished, this, [this, &answered, &stateFirst] {
+        answered = true;
+        stateFirst = m_server->widgetState.value(QStringLiteral("hasSelection")).toBool();
+    });
+    QVERIFY(spinUntil([&answered] { return answered; }));
+    QDBusPendingReply<bool, QString> reply = watcher;
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<1>(), QStringLiteral("hello"));
+    QVERIFY(stateFirst);
+}
+
+void tst_InputContext::selectionFromPositions()
+{
+    SelectionCountingWindow window;
+    window.text = QStringLiteral("hello world");
+    window.cursorPosition = 5;
+    window.anchorPosition = 5;
+    QVERIFY(window.activate());
+    QVERIFY(startContext());
+    QVERIFY(!m_server->widgetState.value(QStringLiteral("hasSelection")).toBool());
+
+    // No selection, nothing to ask the focus object
+    QDBusPendingReply<bool, QString> reply = m_server->asyncCall(QStringLiteral("selection"));
+    QVERIFY(spinUntil([&reply] { return reply.isFinished(); }));
+    QVERIFY(reply.isValid());
+    QCOMPARE(reply.argumentAt<0>(), true);
+    QVERIFY(reply.argumentAt<1>().isEmpty());
+
+    // A cursor update alone also tells about the selection, from the
+    // positions rather than the selected text
+    window.anchorPosition = 0;
+    m_context->update(Qt::ImCursorPosition);
+    QVERIFY(spinUntil([this] { return m_server->widgetState.value(QStringLiteral("hasSelection")).toBool(); }));
+    QCOMPARE(window.selectionQueries, 0);
+
+    m_context.reset();
+}
+
+void tst_InputContext::surroundingTextWindow()
+{
+    BlockInputWindow window;
+    window.text = QStringLiteral("abcdefghij");
+    window.cursorPosition = 2;
+    window.anchorPosition = 9;
+    QVERIFY(window.activate());
+
+    qputenv("MALIIT_SURROUNDING_TEXT_WINDOW", "4");
+    QVERIFY(startContext());
+
+    // Only the cursor's block counts, the anchor is clamped to the window
+    QCOMPARE(m_server->widgetState.value(QStringLiteral("surroundingText")).toString(), QStringLiteral("abcdef"));
+    QCOMPARE(m_server->widgetState.value(QStringLiteral("surroundingTextOffset")).toInt(), 0);
+    QCOMPARE(m_server->widgetState.value(QStringLiteral("cursorPosition")).toInt(), 2);
+    QCOMPARE(m_server->widgetState.value(QStringLiteral("anchorPosition")).toInt(), 6);
+
+    window.cursorPosition = 7;
+    window.anchorPosition = 0;
+    m_context->update(Qt::ImCursorPosition | Qt::ImAnchorPosition);
+    QVERIFY(spinUntil([this] {
+        return m_server->widgetState.value(QStringLiteral("surroundingTextOffset")).toInt() == 3;
+    }));
+    QCOMPARE(m_server->widgetState.value(QStringLiteral("surroundingText")).toString(), QStringLiteral("defghij"));
+    QCOMPARE(m_server->widgetState.value(QStringLiteral("cursorPosition")).toInt(), 4);
+    QCOMPARE(m_server->widgetState.value(QStringLiteral("anchorPosition")).toInt(), 0);
+
+    m_context.reset();
+}
+
+void tst_InputContext::attributeExtensions()
+{
+    QVariantMap attributes;
+    attributes.insert(QStringLiteral("/keys/actionKey/label"), QStringLiteral("Go"));
+    attributes.insert(QStringLiteral("/keys/actionKey/enabled"), true);
+    QVariantMap extension;
+    extension.insert(QStringLiteral("attributes"), attributes);
+    m_window->setProperty(Maliit::InputMethodQuery::attributeExtension, extension);
+
+    QVERIFY(startContext());
+    m_context->update(Qt::ImPlatformData);
+    QVERIFY(spinUntil([this] {
+        return m_server->attributeExtensions.size() == 1
+                && m_server->attributeExtensions.constBegin()->size() == 2;
+    }));
+    // Generated ids stay clear of the ones applications declare
+    const int id = m_server->attributeExtensions.constBegin().key();
+    QVERIFY(id < -1);
+    QCOMPARE(m_server->widgetState.value(QStringLiteral("toolbarId")).toInt(), id);
+
+    // A dropped attribute goes away on the server too
+    attributes.remove(QStringLiteral("/keys/actionKey/enabled"));
+    extension.insert(QStringLiteral("attributes"), attributes);
+    m_window->setProperty(Maliit::InputMethodQuery::attributeExtension, extension);
+    m_context->update(Qt::ImPlatformData);
+    QVERIFY(spinUntil([this, id] { return m_server->attributeExtensions.value(id).size() == 1; }));
+    QCOMPARE(m_server->attributeExtensions.value(id).value(QStringLiteral("/keys/actionKey/label")).toString(),
+             QStringLiteral("Go"));
+}
+
+void tst_InputContext::reconnectReplaysState()
+{
+    QVariantMap attributes;
+    attributes.insert(QStringLiteral("/keys/actionKey/label"), QStringLiteral("Go"));
+    attributes.insert(QStringLiteral("/keys/actionKey/enabled"), true);
+    QVariantMap extension;
+    extension.insert(QStringLiteral("attributes"), attributes);
+    m_window->setProperty(Maliit::InputMethodQuery::attributeExtension, extension);
+
+    QVERIFY(startContext());
+    m_context->update(Qt::ImPlatformData);
+    m_context->showInputPanel();
+    QVERIFY(spinUntil([this] {
+        return m_server->callCount(QStringLiteral("showInputMethod")) == 1
+                && m_server->attributeExtensions.size() == 1;
+    }));
+    QTest::qWait(100);
+
+    // A crashing server forgets everything, the plugin reconnects and
+    // brings the new one up to date
+    m_server->disconnectClient();
+    m_server->callLog.clear();
+    m_server->widgetState.clear();
+    m_server->attributeExtensions.clear();
+    QVERIFY(spinUntil([this] { return m_server->callCount(QStringLiteral("showInputMethod")) == 2; }));
+    QVERIFY(m_server->isConnected());
+
+    // In one go: attribute registrations before the state refers to them,
+    // then activation, orientation, the full state and the input panel
+    QStringList replayed = m_server->callLog;
+    replayed.removeAll(QStringLiteral("setSharedBuffer"));
+    replayed.removeAll(QStringLiteral("enableDeltaUpdates"));
+    QCOMPARE(replayed, QStringList() << QStringLiteral("registerAttributeExtension")
+                                     << QStringLiteral("setExtendedAttribute")
+                                     << QStringLiteral("setExtendedAttribute")
+                                     << QStringLiteral("activateContext")
+                                     << QStringLiteral("appOrientationChanged")
+                                     << QStringLiteral("updateWidgetInformation")
+                                     << QStringLiteral("showInputMethod"));
+
+    QCOMPARE(m_server->focusChanges.last(), true);
+    QCOMPARE(m_server->widgetState.value(QStringLiteral("focusState")).toBool(), true);
+    QCOMPARE(m_server->widgetState.value(QStringLiteral("surroundingText")).toString(), m_window->text);
+    QCOMPARE(m_server->attributeExtensions.size(), 1);
+    const int id = m_server->attributeExtensions.constBegin().key();
+    QCOMPARE(m_server->attributeExtensions.value(id).size(), 2);
+    QCOMPARE(m_server->widgetState.value(QStringLiteral("toolbarId")).toInt(), id);
+    QVERIFY(m_context->isInputPanelVisible());
+}
+
+void tst_InputContext::hideDebounce()
+{
+    QVERIFY(startContext());
+    m_context->showInputPanel();
+    QVERIFY(spinUntil([this] { return m_server->callCount(QStringLiteral("showInputMethod")) == 1; }));
+
+    // Moving to the next field hides and shows again right away, the
+    // server never hears about it
+    m_context->hideInputPanel();
+    m_context->showInputPanel();
+    QTest::qWait(300);
+    QCOMPARE(m_server->callCount(QStringLiteral("hideInputMethod")), 0);
+    QCOMPARE(m_server->callCount(QStringLiteral("showInputMethod")), 1);
+    QVERIFY(m_context->isInputPanelVisible());
+
+    // A hide on its own still goes through, after a moment
+    m_context->hideInputPanel();
+    QVERIFY(m_context->isInputPanelVisible());
+    QVERIFY(spinUntil([this] { return m_server->callCount(QStringLiteral("hideInputMethod")) == 1; }));
+    QVERIFY(!m_context->isInputPanelVisible());
+}
+
+void tst_InputContext::orientationDebounce()
+{
+    QVERIFY(startContext());
+    QVERIFY(spinUntil([this] { return m_server->callCount(QStringLiteral("appOrientationChanged")) == 1; }));
+
+    // The server hears about the rotation right away, but only gets it
+    // confirmed once the orientation stopped changing
+    m_window->reportContentOrientationChange(Qt::LandscapeOrientation);
+    m_window->reportContentOrientationChange(Qt::InvertedLandscapeOrientation);
+    m_window->reportContentOrientationChange(Qt::LandscapeOrientation);
+    QVERIFY(spinUntil([this] { return m_server->callCount(QStringLiteral("appOrientationAboutToChange")) > 0; }));
+    QCOMPARE(m_server->callCount(QStringLiteral("appOrientationChanged")), 1);
+
+    QVERIFY(spinUntil([this] { return m_server->callCount(QStringLiteral("appOrientationChanged")) == 2; }));
+    QTest::qWait(300);
+    QCOMPARE(m_server->callCount(QStringLiteral("appOrientationChanged")), 2);
+}
+
+void tst_InputContext::windowStateCache()
+{
+    m_server->mergesDeltaUpdates = true;
+    QVERIFY(startContext());
+    QVERIFY(waitForDeltaUpdates());
+
+    TestInputWindow other;
+    other.text = QStringLiteral("another window");
+    QVERIFY(other.activate());
+    m_context->setFocusObject(&other);
+    m_context->update(Qt::ImQueryAll);
+    QVERIFY(spinUntil([this, &other] {
+        return m_server->widgetState.value(QStringLiteral("surroundingText")).toString() == other.text;
+    }));
+
+    // Back in a window the server has seen, only what differs is sent and
+    // the context stays active
+    const int updates = m_server->widgetUpdates.size();
+    QVERIFY(m_window->activate());
+    m_context->setFocusObject(m_window.data());
+    m_context->update(Qt::ImQueryAll);
+    QVERIFY(spinUntil([this] {
+        return m_server->widgetState.value(QStringLiteral("surroundingText")).toString() == m_window->text;
+    }));
+    const QVariantMap update = m_server->widgetUpdates.at(updates);
+    QVERIFY(update.contains(QStringLiteral("deltaUpdate")));
+    QVERIFY(update.contains(QStringLiteral("surroundingText")));
+    QVERIFY(!update.contains(QStringLiteral("contentType")));
+    QCOMPARE(m_server->focusChanges.at(updates), true);
+    QCOMPARE(m_server->callCount(QStringLiteral("activateContext")), 1);
+}
+
+void tst_InputContext::keyEvents()
+{
+    QVERIFY(startContext());
+    QVector<Maliit::KeyEventRecord> events;
+    const QString text = QStringLiteral("abc");
+    for (const QChar c : text) {
+        const int key = Qt::Key_A + c.unicode() - 'a';
+        events << Maliit::KeyEventRecord(QEvent::KeyPress, key, 0, c, false, 1, Maliit::EventRequestEventOnly)
+               << Maliit::KeyEventRecord(QEvent::KeyRelease, key, 0, c, false, 1, Maliit::EventRequestEventOnly);
+    }
+    m_server->keyEvents(events);
+
+    // One call, delivered in order
+    QTRY_COMPARE(m_window->keyReleases, 3);
+    QCOMPARE(m_window->keyPresses, 3);
+    QCOMPARE(m_window->typedText, text);
+    QCOMPARE(m_server->callCount(QStringLiteral("processKeyEvent")), 0);
+}
+
+void tst_InputContext::redirectKeys()
+{
+    QVERIFY(startContext());
+    QKeyEvent press(QEvent::KeyPress, Qt::Key_A, Qt::NoModifier, QStringLiteral("a"));
+    press.setTimestamp(1234);
+    QVERIFY(!m_context->filterEvent(&press));
+
+    // Hardware keys go to the server with their time, until it stops asking
+    m_server->send(QStringLiteral("setRedirectKeys"), QVariantList() << true);
+    QVERIFY(spinUntil([this, &press] { return m_context->filterEvent(&press); }));
+    QVERIFY(spinUntil([this] { return m_server->processedKeys.size() == 1; }));
+    QCOMPARE(m_server->processedKeys.first(), qMakePair(int(Qt::Key_A), 1234u));
+
+    m_server->send(QStringLiteral("setRedirectKeys"), QVariantList() << false);
+    QVERIFY(spinUntil([this, &press] { return !m_context->filterEvent(&press); }));
+}
+
+void tst_InputContext::preeditDeduplication()
+{
+    QVERIFY(startContext());
+    QVector<Maliit::PreeditTextFormat> formats;
+    formats << Maliit::PreeditTextFormat(0, 3, Maliit::PreeditDefault);
+
+    // The repeated preedit doesn't reach the application
+    m_server->updatePreedit(QStringLiteral("abc"), formats, 3);
+    m_server->updatePreedit(QStringLiteral("abc"), formats, 3);
+    m_server->updatePreedit(QStringLiteral("abcd"), formats, 4);
+    QTRY_COMPARE(m_window->preedit, QStringLiteral("abcd"));
+    QCOMPARE(m_window->inputMethodEvents, 2);
+}
+
+void tst_InputContext::keyboardAnimation()
+{
+    QVERIFY(startContext());
+    QSignalSpy rectChanged(qGuiApp->inputMethod(), &QInputMethod::keyboardRectangleChanged);
+    QSignalSpy animatingChanged(qGuiApp->inputMethod(), &QInputMethod::animatingChanged);
+
+    // A keyboard sliding in sends a rectangle per frame
+    QRect rect;
+    for (int height = 40; height <= 200; height += 40) {
+        rect = QRect(0, 240 - height, 320, height);
+        m_server->send(QStringLiteral("updateInputMethodArea"),
+                       QVariantList() << rect.x() << rect.y() << rect.width() << rect.height());
+    }
+    QVERIFY(spinUntil([this, rect] { return m_context->keyboardRect() == rect; }));
+    QVERIFY(m_context->isAnimating());
+
+    // Once it settles the final rectangle is announced again
+    QVERIFY(spinUntil([this] { return !m_context->isAnimating(); }));
+    QCOMPARE(animatingChanged.count(), 2);
+    QCOMPARE(rectChanged.count(), 6);
+
+    // The same rectangle again changes nothing, the key event only tells
+    // when it was handled
+    m_server->send(QStringLiteral("updateInputMethodArea"),
+                   QVariantList() << rect.x() << rect.y() << rect.width() << rect.height());
+    m_server->keyEvent(QEvent::KeyRelease, Qt::Key_A, QStringLiteral("a"));
+    QTRY_COMPARE(m_window->keyReleases, 1);
+    QCOMPARE(rectChanged.count(), 6);
+    QVERIFY(!m_context->isAnimating());
+}
+
+MALIIT_TEST_MAIN(tst_InputContext)
+
+#include "tst_inputcontext.moc"
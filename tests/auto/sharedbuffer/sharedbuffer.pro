@@ -0,0 +1,5 @@
+CONFIG += testcase
+TARGET = tst_sharedbuffer
+
+include(../../common/common.pri)
+SOURCES += tst_sharedbuffer.cpp
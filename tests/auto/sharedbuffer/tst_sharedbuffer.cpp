@@ -0,0 +1,207 @@
+/* * This file is part of Maliit framework *
+ *
+ * Contact: maliit-discuss@lists.maliit.org
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * and appearing in the file LICENSE.LGPL included in the packaging
+ * of this file.
+ */
+
+#include "maliittest.h"
+#include "mockserver.h"
+#include "qmaliitplatforminputcontext.h"
+#include "qmsharedbuffer.h"
+
+#include <sys/mman.h>
+
+namespace
+{
+    // Room for four of the payloads below
+    const quint32 RingSize = QMaliitSharedBuffer::HeaderSize + 4 * 256;
+    const quint32 PayloadSize = 256;
+}
+
+class tst_SharedBuffer : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void init();
+    void cleanup();
+
+    void keepsUnreleasedPayloads();
+    void payloadsDontWrap();
+    void sharedWhenAccepted();
+    void inlineWhenDeclined();
+    void inlineWhenRingFull();
+
+private:
+    bool startContext();
+    bool changeText(QChar fill, int length);
+
+    QScopedPointer<MockServer> m_server;
+    QScopedPointer<QMaliitPlatformInputContext> m_context;
+    QScopedPointer<TestInputWindow> m_window;
+};
+
+void tst_SharedBuffer::init()
+{
+    m_window.reset(new TestInputWindow);
+    QVERIFY(m_window->activate());
+    m_server.reset(new MockServer);
+}
+
+void tst_SharedBuffer::cleanup()
+{
+    m_context.reset();
+    m_server.reset();
+    m_window.reset();
+    qunsetenv("MALIIT_SERVER_ADDRESS");
+}
+
+bool tst_SharedBuffer::startContext()
+{
+    m_context.reset(startInputContext(m_server.data()));
+    if (!m_context || !m_server->acceptsSharedBuffer)
+        return !m_context.isNull();
+
+    // Payloads go inline until the plugin got the server's answer
+    MockServer *server = m_server.data();
+    int serial = 0;
+    const bool shared = spinUntil([this, server, &serial] {
+        return changeText(QLatin1Char(++serial % 2 ? 'x' : 'y'), 4 * 1024)
+                && server->widgetUpdates.last().contains(QStringLiteral("surroundingTextShm"));
+    });
+    m_server->sharedPayloads = 0;
+    return shared;
+}
+
+// Sends a text of its own and waits for the update carrying it
+bool tst_SharedBuffer::changeText(QChar fill, int length)
+{
+    m_window->text = QString(length, fill);
+    m_context->update(Qt::ImSurroundingText);
+    MockServer *server = m_server.data();
+    const QString text = m_window->text;
+    return spinUntil([server, text] {
+        return server->widgetState.value(QStringLiteral("surroundingText")).toString() == text;
+    });
+}
+
+void tst_SharedBuffer::keepsUnreleasedPayloads()
+{
+    QMaliitSharedBuffer buffer(1, RingSize);
+    QVERIFY(buffer.isValid());
+    uchar *server = static_cast<uchar *>(mmap(nullptr, RingSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                                              buffer.fileDescriptor(), 0));
+    QVERIFY(server != MAP_FAILED);
+
+    const QByteArray payload(PayloadSize, 'a');
+    QList<quint32> offsets;
+    QList<quint64> ends;
+    for (int i = 0; i < 4; ++i) {
+        quint32 offset;
+        quint64 end;
+        QVERIFY(buffer.write(payload.constData(), PayloadSize, &offset, &end));
+        QVERIFY(offset >= quint32(QMaliitSharedBuffer::HeaderSize));
+        offsets << offset;
+        ends << end;
+    }
+
+    // Nothing released, the ring is full
+    quint32 offset;
+    quint64 end;
+    const QByteArray next(PayloadSize, 'b');
+    QVERIFY(!buffer.write(next.constData(), PayloadSize, &offset, &end));
+
+    // Releasing the first payload makes room for exactly one more, which
+    // leaves the other three alone
+    QMaliitSharedBuffer::release(server, ends.first());
+    QVERIFY(buffer.write(next.constData(), PayloadSize, &offset, &end));
+    QCOMPARE(offset, offsets.first());
+    QVERIFY(!buffer.write(next.constData(), PayloadSize, &offset, &end));
+    for (int i = 1; i < 4; ++i)
+        QCOMPARE(QByteArray(reinterpret_cast<const char *>(server + offsets.at(i)), PayloadSize), payload);
+    QCOMPARE(QByteArray(reinterpret_cast<const char *>(server + offsets.first()), PayloadSize), next);
+
+    munmap(server, RingSize);
+}
+
+void tst_SharedBuffer::payloadsDontWrap()
+{
+    QMaliitSharedBuffer buffer(1, RingSize);
+    QVERIFY(buffer.isValid());
+    uchar *server = static_cast<uchar *>(mmap(nullptr, RingSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                                              buffer.fileDescriptor(), 0));
+    QVERIFY(server != MAP_FAILED);
+
+    const QByteArray payload(3 * PayloadSize, 'a');
+    quint32 offset;
+    quint64 end;
+    QVERIFY(buffer.write(payload.constData(), payload.size(), &offset, &end));
+    QMaliitSharedBuffer::release(server, end);
+
+    // Doesn't fit behind the first one, so it starts over at the beginning
+    // and the skipped tail counts as used until it is released
+    QVERIFY(buffer.write(payload.constData(), payload.size(), &offset, &end));
+    QCOMPARE(offset, quint32(QMaliitSharedBuffer::HeaderSize));
+    QCOMPARE(end, quint64(4 * PayloadSize + 3 * PayloadSize));
+
+    // Larger than the ring never fits
+    const QByteArray huge(RingSize, 'b');
+    QMaliitSharedBuffer::release(server, end);
+    QVERIFY(!buffer.write(huge.constData(), huge.size(), &offset, &end));
+
+    munmap(server, RingSize);
+}
+
+void tst_SharedBuffer::sharedWhenAccepted()
+{
+    m_server->acceptsSharedBuffer = true;
+    QVERIFY(startContext());
+
+    QVERIFY(changeText(QLatin1Char('a'), 8 * 1024));
+    QVERIFY(m_server->widgetUpdates.last().contains(QStringLiteral("surroundingTextShm")));
+    QVERIFY(!m_server->widgetUpdates.last().contains(QStringLiteral("surroundingText")));
+    QCOMPARE(m_server->sharedPayloads, 1);
+
+    // Short texts aren't worth it
+    QVERIFY(changeText(QLatin1Char('b'), 16));
+    QVERIFY(m_server->widgetUpdates.last().contains(QStringLiteral("surroundingText")));
+    QCOMPARE(m_server->sharedPayloads, 1);
+}
+
+void tst_SharedBuffer::inlineWhenDeclined()
+{
+    QVERIFY(startContext());
+
+    QVERIFY(changeText(QLatin1Char('a'), 8 * 1024));
+    QVERIFY(m_server->widgetUpdates.last().contains(QStringLiteral("surroundingText")));
+    QVERIFY(!m_server->widgetUpdates.last().contains(QStringLiteral("surroundingTextShm")));
+    QCOMPARE(m_server->sharedPayloads, 0);
+}
+
+void tst_SharedBuffer::inlineWhenRingFull()
+{
+    m_server->acceptsSharedBuffer = true;
+    m_server->releasesSharedPayloads = false;
+    QVERIFY(startContext());
+
+    // Two of these fill most of the default ring, the server is stuck and
+    // the third one must not overwrite them
+    const int length = QMaliitSharedBuffer::DefaultSize / 3 / int(sizeof(QChar));
+    QVERIFY(changeText(QLatin1Char('a'), length));
+    QVERIFY(changeText(QLatin1Char('b'), length));
+    QCOMPARE(m_server->sharedPayloads, 2);
+
+    QVERIFY(changeText(QLatin1Char('c'), length));
+    QVERIFY(m_server->widgetUpdates.last().contains(QStringLiteral("surroundingText")));
+    QVERIFY(!m_server->widgetUpdates.last().contains(QStringLiteral("surroundingTextShm")));
+    QCOMPARE(m_server->sharedPayloads, 2);
+}
+
+MALIIT_TEST_MAIN(tst_SharedBuffer)
+
+#include "tst_sharedbuffer.moc"
@@ -0,0 +1,80 @@
+/* * This file is part of Maliit framework *
+ *
+ * Contact: maliit-discuss@lists.maliit.org
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * and appearing in the file LICENSE.LGPL included in the packaging
+ * of this file.
+ */
+
+#include "allocationcounter.h"
+
+#include <cstdlib>
+
+namespace
+{
+    // Plain thread locals in the executable, reading them never allocates
+    thread_local bool t_counting = false;
+    thread_local qint64 t_allocations = 0;
+}
+
+#if defined(__GLIBC__)
+
+extern "C" {
+
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *pointer, size_t size);
+
+// Qt's containers allocate with malloc() directly, counting operator new
+// would miss most of them
+void *malloc(size_t size)
+{
+    if (t_counting)
+        ++t_allocations;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    if (t_counting)
+        ++t_allocations;
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size)
+{
+    if (t_counting)
+        ++t_allocations;
+    return __libc_realloc(pointer, size);
+}
+
+}
+
+bool AllocationCounter::isSupported()
+{
+    return true;
+}
+
+#else
+
+bool AllocationCounter::isSupported()
+{
+    return false;
+}
+
+#endif
+
+void AllocationCounter::start()
+{
+    t_allocations = 0;
+    t_counting = true;
+}
+
+qint64 AllocationCounter::stop()
+{
+    t_counting = false;
+    return t_allocations;
+}
@@ -0,0 +1,29 @@
+/* * This file is part of Maliit framework *
+ *
+ * Contact: maliit-discuss@lists.maliit.org
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * and appearing in the file LICENSE.LGPL included in the packaging
+ * of this file.
+ */
+
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <QtGlobal>
+
+/*
+ * Counts heap allocations made by the calling thread, by interposing
+ * malloc(). Only available with glibc, elsewhere isSupported() is false.
+ */
+namespace AllocationCounter
+{
+    bool isSupported();
+    void start();
+    //! Allocations since start()
+    qint64 stop();
+}
+
+#endif
@@ -0,0 +1,6 @@
+CONFIG += benchmark
+include($$PWD/../common/common.pri)
+INCLUDEPATH += $$PWD
+
+HEADERS += $$PWD/allocationcounter.h
+SOURCES += $$PWD/allocationcounter.cpp
@@ -0,0 +1,4 @@
+TARGET = tst_bench_dispatch
+
+include(../benchmarks.pri)
+SOURCES += tst_bench_dispatch.cpp
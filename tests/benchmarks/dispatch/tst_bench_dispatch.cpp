@@ -0,0 +1,189 @@
+/* * This file is part of Maliit framework *
+ *
+ * Contact: maliit-discuss@lists.maliit.org
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * and appearing in the file LICENSE.LGPL included in the packaging
+ * of this file.
+ */
+
+#include "maliittest.h"
+#include "mockserver.h"
+#include "qmaliitplatforminputcontext.h"
+#include "qmcontextadaptor.h"
+
+#include <functional>
+
+/*
+ * Cost of handing one inbound call of each message type to the context, as
+ * the adaptor does once QtDBus demarshalled it. "typed" rows call the
+ * adaptor's slot, which calls the context directly. "by name" rows forward
+ * the same arguments through QMetaObject::invokeMethod, like the adaptor did
+ * before, so the difference between the two is the dispatch overhead. Both
+ * run on the GUI thread and include the context's own work.
+ */
+class tst_BenchDispatch : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void dispatch_data();
+    void dispatch();
+
+private:
+    std::function<void()> typedCall(const QString &message);
+    std::function<void()> callByName(const QString &message);
+
+    QScopedPointer<MockServer> m_server;
+    TestInputWindow m_window;
+    QScopedPointer<QMaliitPlatformInputContext> m_context;
+    QScopedPointer<QMaliitInputcontext1Object> m_object;
+    QMaliitInputcontext1Adaptor *m_adaptor;
+    QVector<Maliit::PreeditTextFormat> m_formats;
+    QVector<Maliit::KeyEventRecord> m_keyEvents;
+    int m_serial;
+};
+
+void tst_BenchDispatch::initTestCase()
+{
+    m_serial = 0;
+    m_formats << Maliit::PreeditTextFormat(0, 4, Maliit::PreeditDefault)
+              << Maliit::PreeditTextFormat(4, 1, Maliit::PreeditActive);
+    m_keyEvents << Maliit::KeyEventRecord(QEvent::KeyPress, Qt::Key_A, 0, QStringLiteral("a"), false, 1,
+                                          Maliit::EventRequestEventOnly)
+                << Maliit::KeyEventRecord(QEvent::KeyRelease, Qt::Key_A, 0, QStringLiteral("a"), false, 1,
+                                          Maliit::EventRequestEventOnly);
+
+    m_window.text = QStringLiteral("The quick brown fox jumps over the lazy dog");
+    m_window.cursorPosition = m_window.text.length();
+    m_window.anchorPosition = m_window.cursorPosition;
+    QVERIFY(m_window.activate());
+
+    // Connected like in an application, so the context does all of its work
+    m_server.reset(new MockServer);
+    m_context.reset(startInputContext(m_server.data()));
+    QVERIFY(m_context);
+
+    // Not registered on a connection, the GUI thread calls the slots
+    m_object.reset(new QMaliitInputcontext1Object(m_context.data()));
+    m_adaptor = new QMaliitInputcontext1Adaptor(m_object.data());
+}
+
+void tst_BenchDispatch::cleanupTestCase()
+{
+    m_object.reset();
+    m_context.reset();
+    m_server.reset();
+    qunsetenv("MALIIT_SERVER_ADDRESS");
+}
+
+void tst_BenchDispatch::dispatch_data()
+{
+    QTest::addColumn<QString>("message");
+    QTest::addColumn<bool>("typed");
+
+    const char * const messages[] = {
+        "commitString", "keyEvent", "keyEvents", "updatePreedit",
+        "updateInputMethodArea", "setSelection", "setRedirectKeys", "setLanguage"
+    };
+    for (const char *message : messages) {
+        QTest::newRow(QByteArray(message).append(" typed").constData()) << QString::fromLatin1(message) << true;
+        QTest::newRow(QByteArray(message).append(" by name").constData()) << QString::fromLatin1(message) << false;
+    }
+}
+
+void tst_BenchDispatch::dispatch()
+{
+    QFETCH(QString, message);
+    QFETCH(bool, typed);
+    const std::function<void()> call = typed ? typedCall(message) : callByName(message);
+    QVERIFY(call);
+
+    // Warm up caches, and the context's state for calls that only act on changes
+    for (int i = 0; i < 10; ++i)
+        call();
+
+    QBENCHMARK {
+        call();
+    }
+}
+
+// The arguments alternate where the context drops repeated values early
+std::function<void()> tst_BenchDispatch::typedCall(const QString &message)
+{
+    if (message == QLatin1String("commitString")) {
+        return [this] { m_adaptor->commitString(QStringLiteral("a"), 0, 0, -1); };
+    } else if (message == QLatin1String("keyEvent")) {
+        return [this] {
+            m_adaptor->keyEvent(QEvent::KeyPress, Qt::Key_A, 0, QStringLiteral("a"), false, 1,
+                                Maliit::EventRequestEventOnly);
+        };
+    } else if (message == QLatin1String("keyEvents")) {
+        return [this] { m_adaptor->keyEvents(m_keyEvents); };
+    } else if (message == QLatin1String("updatePreedit")) {
+        return [this] {
+            m_adaptor->updatePreedit(++m_serial % 2 ? QStringLiteral("quic") : QStringLiteral("quick"),
+                                     m_formats, 0, 0, 4);
+        };
+    } else if (message == QLatin1String("updateInputMethodArea")) {
+        return [this] { m_adaptor->updateInputMethodArea(0, 280, 320, ++m_serial % 2 ? 200 : 210); };
+    } else if (message == QLatin1String("setSelection")) {
+        return [this] { m_adaptor->setSelection(++m_serial % 2, 1); };
+    } else if (message == QLatin1String("setRedirectKeys")) {
+        return [this] { m_adaptor->setRedirectKeys(true); };
+    } else if (message == QLatin1String("setLanguage")) {
+        return [this] { m_adaptor->setLanguage(QStringLiteral("en")); };
+    }
+    return std::function<void()>();
+}
+
+std::function<void()> tst_BenchDispatch::callByName(const QString &message)
+{
+    QObject *context = m_context.data();
+    if (message == QLatin1String("commitString")) {
+        return [context] {
+            QMetaObject::invokeMethod(context, "commitString", Q_ARG(QString, QStringLiteral("a")),
+                                      Q_ARG(int, 0), Q_ARG(int, 0), Q_ARG(int, -1));
+        };
+    } else if (message == QLatin1String("keyEvent")) {
+        return [context] {
+            QMetaObject::invokeMethod(context, "keyEvent", Q_ARG(int, QEvent::KeyPress), Q_ARG(int, Qt::Key_A),
+                                      Q_ARG(int, 0), Q_ARG(QString, QStringLiteral("a")), Q_ARG(bool, false),
+                                      Q_ARG(int, 1), Q_ARG(uchar, Maliit::EventRequestEventOnly));
+        };
+    } else if (message == QLatin1String("keyEvents")) {
+        return [this, context] {
+            QMetaObject::invokeMethod(context, "keyEvents", Q_ARG(QVector<Maliit::KeyEventRecord>, m_keyEvents));
+        };
+    } else if (message == QLatin1String("updatePreedit")) {
+        return [this, context] {
+            QMetaObject::invokeMethod(context, "updatePreedit",
+                                      Q_ARG(QString, ++m_serial % 2 ? QStringLiteral("quic") : QStringLiteral("quick")),
+                                      Q_ARG(QVector<Maliit::PreeditTextFormat>, m_formats),
+                                      Q_ARG(int, 0), Q_ARG(int, 0), Q_ARG(int, 4));
+        };
+    } else if (message == QLatin1String("updateInputMethodArea")) {
+        return [this, context] {
+            QMetaObject::invokeMethod(context, "updateInputMethodArea", Q_ARG(int, 0), Q_ARG(int, 280),
+                                      Q_ARG(int, 320), Q_ARG(int, ++m_serial % 2 ? 200 : 210));
+        };
+    } else if (message == QLatin1String("setSelection")) {
+        return [this, context] {
+            QMetaObject::invokeMethod(context, "setSelection", Q_ARG(int, ++m_serial % 2), Q_ARG(int, 1));
+        };
+    } else if (message == QLatin1String("setRedirectKeys")) {
+        return [context] { QMetaObject::invokeMethod(context, "setRedirectKeys", Q_ARG(bool, true)); };
+    } else if (message == QLatin1String("setLanguage")) {
+        return [context] { QMetaObject::invokeMethod(context, "setLanguage", Q_ARG(QString, QStringLiteral("en"))); };
+    }
+    return std::function<void()>();
+}
+
+MALIIT_TEST_MAIN(tst_BenchDispatch)
+
+#include "tst_bench_dispatch.moc"
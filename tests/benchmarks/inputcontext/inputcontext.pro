@@ -0,0 +1,4 @@
+TARGET = tst_bench_inputcontext
+
+include(../benchmarks.pri)
+SOURCES += tst_bench_inputcontext.cpp
@@ -0,0 +1,274 @@
+/* * This file is part of Maliit framework *
+ *
+ * Contact: maliit-discuss@lists.maliit.org
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * and appearing in the file LICENSE.LGPL included in the packaging
+ * of this file.
+ */
+
+#include "allocationcounter.h"
+#include "maliittest.h"
+#include "mockserver.h"
+#include "qmaliitplatforminputcontext.h"
+
+#include <QThread>
+
+#include <functional>
+
+namespace
+{
+    // Calls per measurement over D-Bus, about a second of fast typing
+    const int BatchSize = 20;
+    // Calls per allocation count
+    const int AllocationIterations = 1000;
+}
+
+/*
+ * Hot paths of the plugin against a stand-in server running on a thread of
+ * its own. "direct" rows call the context like the adaptor does and
+ * measure the plugin alone. "dbus" rows send a batch of calls from the
+ * server and measure until the focus object handled the last one, i.e. the
+ * throughput and latency of the whole inbound path.
+ */
+class tst_BenchInputContext : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void update_data();
+    void update();
+    void setFocusObject();
+    void commitString_data();
+    void commitString();
+    void updatePreedit_data();
+    void updatePreedit();
+    void keyEvent_data();
+    void keyEvent();
+    void allocations_data();
+    void allocations();
+
+private:
+    void addPathRows();
+    void typeCharacter();
+    void changePreedit();
+
+    QThread m_serverThread;
+    MockServer *m_server;
+    TestInputWindow m_window;
+    QScopedPointer<QMaliitPlatformInputContext> m_context;
+    QVector<Maliit::PreeditTextFormat> m_formats;
+    int m_preeditSerial;
+};
+
+void tst_BenchInputContext::initTestCase()
+{
+    m_preeditSerial = 0;
+    m_formats << Maliit::PreeditTextFormat(0, 4, Maliit::PreeditDefault)
+              << Maliit::PreeditTextFormat(4, 2, Maliit::PreeditActive);
+
+    m_window.text = QStringLiteral("The quick brown fox jumps over the lazy dog");
+    m_window.cursorPosition = m_window.text.length();
+    m_window.anchorPosition = m_window.cursorPosition;
+    QVERIFY(m_window.activate());
+
+    // The server's work doesn't compete with the plugin's for the GUI thread
+    m_server = new MockServer;
+    m_server->mergesDeltaUpdates = true;
+    m_server->moveToThread(&m_serverThread);
+    m_serverThread.start();
+
+    m_context.reset(startInputContext(m_server));
+    QVERIFY(m_context);
+}
+
+void tst_BenchInputContext::cleanupTestCase()
+{
+    m_context.reset();
+    m_server->deleteLater();
+    m_serverThread.quit();
+    m_serverThread.wait();
+    qunsetenv("MALIIT_SERVER_ADDRESS");
+}
+
+void tst_BenchInputContext::addPathRows()
+{
+    QTest::addColumn<bool>("overDBus");
+    QTest::newRow("direct") << false;
+    QTest::newRow("dbus") << true;
+}
+
+// What the application reports after every keystroke
+void tst_BenchInputContext::typeCharacter()
+{
+    m_window.cursorPosition = (m_window.cursorPosition + 1) % (m_window.text.length() + 1);
+    m_window.anchorPosition = m_window.cursorPosition;
+    m_window.cursorRectangle.moveLeft(m_window.cursorPosition * 8);
+    m_context->update(Qt::ImQueryInput);
+    // The context coalesces updates until the event loop runs
+    QCoreApplication::processEvents();
+}
+
+void tst_BenchInputContext::changePreedit()
+{
+    // Repeated preedits are dropped early, a new one per keystroke is realistic
+    static const QString preedits[] = { QStringLiteral("quic"), QStringLiteral("quick") };
+    m_context->updatePreedit(preedits[++m_preeditSerial % 2], m_formats, 0, 0, 4);
+}
+
+void tst_BenchInputContext::update_data()
+{
+    QTest::addColumn<int>("textLength");
+    QTest::newRow("short text") << 40;
+    QTest::newRow("long text") << 64 * 1024;
+}
+
+void tst_BenchInputContext::update()
+{
+    QFETCH(int, textLength);
+    const QString text = m_window.text;
+    m_window.text = QString(textLength, QLatin1Char('x'));
+
+    QBENCHMARK {
+        typeCharacter();
+    }
+
+    m_window.text = text;
+    m_window.cursorPosition = 0;
+    m_window.anchorPosition = 0;
+    m_context->update(Qt::ImQueryAll);
+    QCoreApplication::processEvents();
+}
+
+void tst_BenchInputContext::setFocusObject()
+{
+    QBENCHMARK {
+        m_context->setFocusObject(&m_window);
+    }
+}
+
+void tst_BenchInputContext::commitString_data()
+{
+    addPathRows();
+}
+
+void tst_BenchInputContext::commitString()
+{
+    QFETCH(bool, overDBus);
+
+    if (!overDBus) {
+        QBENCHMARK {
+            m_context->commitString(QStringLiteral("a"));
+        }
+        return;
+    }
+
+    QBENCHMARK {
+        const int expected = m_window.commits + BatchSize;
+        for (int i = 0; i < BatchSize; ++i)
+            m_server->commitString(QStringLiteral("a"));
+        QVERIFY(spinUntil([this, expected] { return m_window.commits >= expected; }));
+    }
+}
+
+void tst_BenchInputContext::updatePreedit_data()
+{
+    addPathRows();
+}
+
+void tst_BenchInputContext::updatePreedit()
+{
+    QFETCH(bool, overDBus);
+
+    if (!overDBus) {
+        QBENCHMARK {
+            changePreedit();
+        }
+        return;
+    }
+
+    QBENCHMARK {
+        const int expected = m_window.inputMethodEvents + BatchSize;
+        for (int i = 0; i < BatchSize; ++i)
+            m_server->updatePreedit(i % 2 ? QStringLiteral("quick") : QStringLiteral("quic"), m_formats, 4);
+        QVERIFY(spinUntil([this, expected] { return m_window.inputMethodEvents >= expected; }));
+    }
+}
+
+void tst_BenchInputContext::keyEvent_data()
+{
+    addPathRows();
+}
+
+void tst_BenchInputContext::keyEvent()
+{
+    QFETCH(bool, overDBus);
+
+    if (!overDBus) {
+        QBENCHMARK {
+            m_context->keyEvent(QEvent::KeyPress, Qt::Key_A, 0, QStringLiteral("a"), false, 1,
+                                Maliit::EventRequestEventOnly);
+        }
+        return;
+    }
+
+    QBENCHMARK {
+        const int expected = m_window.keyPresses + BatchSize;
+        for (int i = 0; i < BatchSize; ++i)
+            m_server->keyEvent(QEvent::KeyPress, Qt::Key_A, QStringLiteral("a"));
+        QVERIFY(spinUntil([this, expected] { return m_window.keyPresses >= expected; }));
+    }
+}
+
+void tst_BenchInputContext::allocations_data()
+{
+    QTest::addColumn<QString>("path");
+    QTest::newRow("update") << QStringLiteral("update");
+    QTest::newRow("setFocusObject") << QStringLiteral("setFocusObject");
+    QTest::newRow("commitString") << QStringLiteral("commitString");
+    QTest::newRow("updatePreedit") << QStringLiteral("updatePreedit");
+    QTest::newRow("keyEvent") << QStringLiteral("keyEvent");
+}
+
+// Heap allocations per call on the GUI thread, reported as events
+void tst_BenchInputContext::allocations()
+{
+    if (!AllocationCounter::isSupported())
+        QSKIP("Allocations can only be counted with glibc");
+
+    QFETCH(QString, path);
+    std::function<void()> call;
+    if (path == QLatin1String("update")) {
+        call = [this] { typeCharacter(); };
+    } else if (path == QLatin1String("setFocusObject")) {
+        call = [this] { m_context->setFocusObject(&m_window); };
+    } else if (path == QLatin1String("commitString")) {
+        call = [this] { m_context->commitString(QStringLiteral("a")); };
+    } else if (path == QLatin1String("updatePreedit")) {
+        call = [this] { changePreedit(); };
+    } else {
+        call = [this] {
+            m_context->keyEvent(QEvent::KeyPress, Qt::Key_A, 0, QStringLiteral("a"), false, 1,
+                                Maliit::EventRequestEventOnly);
+        };
+    }
+
+    // Warm up caches and reserved capacity first
+    for (int i = 0; i < 10; ++i)
+        call();
+
+    AllocationCounter::start();
+    for (int i = 0; i < AllocationIterations; ++i)
+        call();
+    const qint64 allocations = AllocationCounter::stop();
+    QTest::setBenchmarkResult(qreal(allocations) / AllocationIterations, QTest::Events);
+}
+
+MALIIT_TEST_MAIN(tst_BenchInputContext)
+
+#include "tst_bench_inputcontext.moc"
@@ -0,0 +1,223 @@
+/* * This file is part of Maliit framework *
+ *
+ * Contact: maliit-discuss@lists.maliit.org
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * and appearing in the file LICENSE.LGPL included in the packaging
+ * of this file.
+ */
+
+#include "maliittest.h"
+#include "qmcontextadaptor.h"
+
+#include <QThread>
+
+namespace
+{
+    const char * const Interface = "com.meego.inputmethod.inputcontext1";
+    const char * const TypedPath = "/typed";
+    const char * const ByHandPath = "/byhand";
+}
+
+// Lets QtDBus decode the formats with the plugin's operators, like the adaptor
+class TypedPreeditReceiver : public QObject
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "com.meego.inputmethod.inputcontext1")
+
+public:
+    explicit TypedPreeditReceiver(QObject *parent) : QObject(parent) {}
+
+    QAtomicInt calls;
+    QAtomicInt segments; // decoded by the last call
+
+public Q_SLOTS:
+    void updatePreedit(const QString &text, const QVector<Maliit::PreeditTextFormat> &formats,
+                       int replacementStart, int replacementLength, int cursorPos)
+    {
+        Q_UNUSED(text);
+        Q_UNUSED(replacementStart);
+        Q_UNUSED(replacementLength);
+        Q_UNUSED(cursorPos);
+        segments.storeRelease(formats.size());
+        calls.ref();
+    }
+};
+
+// Takes the raw message and walks the array like the plugin used to
+class ByHandPreeditReceiver : public QObject
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "com.meego.inputmethod.inputcontext1")
+
+public:
+    explicit ByHandPreeditReceiver(QObject *parent) : QObject(parent) {}
+
+    QAtomicInt calls;
+    QAtomicInt segments;
+
+public Q_SLOTS:
+    void updatePreedit(const QDBusMessage &message)
+    {
+        QList<QVariant> arguments = message.arguments();
+        if (arguments.count() != 5)
+            return;
+
+        const QString text = arguments[0].toString();
+
+        QVector<Maliit::PreeditTextFormat> formats;
+        const QDBusArgument formatArgument = arguments[1].value<QDBusArgument>();
+        formatArgument.beginArray();
+        while (!formatArgument.atEnd()) {
+            formatArgument.beginStructure();
+            int start, length, preeditFace;
+            formatArgument >> start >> length >> preeditFace;
+            formatArgument.endStructure();
+
+            formats.append(Maliit::PreeditTextFormat(start, length, Maliit::PreeditFace(preeditFace)));
+        }
+        formatArgument.endArray();
+
+        int replacementStart = arguments[2].toInt();
+        int replacementLength = arguments[3].toInt();
+        int cursorPos = arguments[4].toInt();
+        Q_UNUSED(text);
+        Q_UNUSED(replacementStart);
+        Q_UNUSED(replacementLength);
+        Q_UNUSED(cursorPos);
+
+        segments.storeRelease(formats.size());
+        calls.ref();
+    }
+};
+
+// Receiving end of the peer connection, decodes on a thread of its own
+class PreeditReceivers : public QObject
+{
+    Q_OBJECT
+
+public:
+    PreeditReceivers()
+        : typed(this)
+        , byHand(this)
+        , m_server(new QDBusServer(this))
+        , m_connection(QString())
+    {
+        connect(m_server, &QDBusServer::newConnection, this, &PreeditReceivers::newConnection);
+    }
+
+    ~PreeditReceivers()
+    {
+        if (m_connection.isConnected())
+            QDBusConnection::disconnectFromPeer(m_connection.name());
+    }
+
+    QString address() const { return m_server->address(); }
+
+    TypedPreeditReceiver typed;
+    ByHandPreeditReceiver byHand;
+
+private:
+    void newConnection(const QDBusConnection &connection)
+    {
+        m_connection = connection;
+        m_connection.registerObject(QLatin1String(TypedPath), &typed, QDBusConnection::ExportAllSlots);
+        m_connection.registerObject(QLatin1String(ByHandPath), &byHand, QDBusConnection::ExportAllSlots);
+    }
+
+    QDBusServer *m_server;
+    QDBusConnection m_connection;
+};
+
+/*
+ * Decoding the a(iii) preedit formats of updatePreedit with growing segment
+ * counts. "typed" rows let QtDBus decode them into a vector as the adaptor
+ * does, "by hand" rows copy the message's arguments and walk the
+ * QDBusArgument like the plugin used to. Each call is measured from sending
+ * until the receiver decoded it, so both include the same marshalling and
+ * transport.
+ */
+class tst_BenchPreeditFormats : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void updatePreedit_data();
+    void updatePreedit();
+
+private:
+    QThread m_receiverThread;
+    PreeditReceivers *m_receivers;
+    QDBusConnection m_connection = QDBusConnection(QString());
+};
+
+void tst_BenchPreeditFormats::initTestCase()
+{
+    qDBusRegisterMetaType<Maliit::PreeditTextFormat>();
+    qDBusRegisterMetaType<QVector<Maliit::PreeditTextFormat> >();
+
+    m_receivers = new PreeditReceivers;
+    m_receivers->moveToThread(&m_receiverThread);
+    m_receiverThread.start();
+
+    m_connection = QDBusConnection::connectToPeer(m_receivers->address(), QStringLiteral("preeditformats"));
+    QVERIFY(m_connection.isConnected());
+}
+
+void tst_BenchPreeditFormats::cleanupTestCase()
+{
+    QDBusConnection::disconnectFromPeer(m_connection.name());
+    m_receivers->deleteLater();
+    m_receiverThread.quit();
+    m_receiverThread.wait();
+}
+
+void tst_BenchPreeditFormats::updatePreedit_data()
+{
+    QTest::addColumn<int>("segments");
+    QTest::addColumn<bool>("typed");
+
+    for (int segments = 1; segments <= 10000; segments *= 10) {
+        QTest::newRow(QByteArray::number(segments).append(" typed").constData()) << segments << true;
+        QTest::newRow(QByteArray::number(segments).append(" by hand").constData()) << segments << false;
+    }
+}
+
+void tst_BenchPreeditFormats::updatePreedit()
+{
+    QFETCH(int, segments);
+    QFETCH(bool, typed);
+
+    // One segment per character, alternating faces like a conversion string
+    QVector<Maliit::PreeditTextFormat> formats;
+    formats.reserve(segments);
+    for (int i = 0; i < segments; ++i)
+        formats << Maliit::PreeditTextFormat(i, 1, i % 2 ? Maliit::PreeditActive : Maliit::PreeditDefault);
+
+    QDBusMessage message = QDBusMessage::createMethodCall(QString(),
+                                                          QLatin1String(typed ? TypedPath : ByHandPath),
+                                                          QLatin1String(Interface),
+                                                          QStringLiteral("updatePreedit"));
+    message.setArguments(QVariantList() << QString(segments, QLatin1Char('x')) << QVariant::fromValue(formats)
+                                        << 0 << 0 << segments);
+
+    QAtomicInt &calls = typed ? m_receivers->typed.calls : m_receivers->byHand.calls;
+    QAtomicInt &decoded = typed ? m_receivers->typed.segments : m_receivers->byHand.segments;
+
+    QBENCHMARK {
+        const int expected = calls.loadAcquire() + 1;
+        QVERIFY(m_connection.send(message));
+        QVERIFY(spinUntil([&calls, expected] { return calls.loadAcquire() >= expected; }));
+    }
+
+    QCOMPARE(decoded.loadAcquire(), segments);
+}
+
+MALIIT_TEST_MAIN(tst_BenchPreeditFormats)
+
+#include "tst_bench_preeditformats.moc"
@@ -0,0 +1,10 @@
+# The tests build the plugin's sources in and talk to a stand-in server
+QT += testlib
+include($$PWD/../../maliit.pri)
+INCLUDEPATH += $$PWD
+
+HEADERS += $$PWD/maliittest.h \
+           $$PWD/mockserver.h
+
+SOURCES += $$PWD/maliittest.cpp \
+           $$PWD/mockserver.cpp
@@ -0,0 +1,122 @@
+/* * This file is part of Maliit framework *
+ *
+ * Contact: maliit-discuss@lists.maliit.org
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * and appearing in the file LICENSE.LGPL included in the packaging
+ * of this file.
+ */
+
+#include "maliittest.h"
+
+#include "mockserver.h"
+#include "qmaliitplatforminputcontext.h"
+
+#include <QInputMethodEvent>
+#include <QInputMethodQueryEvent>
+#include <QKeyEvent>
+
+TestInputWindow::TestInputWindow(QWindow *parent)
+    : QWindow(parent)
+    , cursorPosition(0)
+    , anchorPosition(0)
+    , hints(Qt::ImhNone)
+    , cursorRectangle(10, 10, 2, 16)
+    , inputMethodEvents(0)
+    , commits(0)
+    , preeditAttributes(0)
+    , keyPresses(0)
+    , keyReleases(0)
+{
+    setGeometry(0, 0, 320, 240);
+}
+
+bool TestInputWindow::activate()
+{
+    show();
+    requestActivate();
+    return QTest::qWaitForWindowActive(this);
+}
+
+bool TestInputWindow::event(QEvent *event)
+{
+    switch (event->type()) {
+    case QEvent::InputMethodQuery: {
+        QInputMethodQueryEvent *query = static_cast<QInputMethodQueryEvent *>(event);
+        for (uint bit = 1; bit && bit <= uint(query->queries()); bit <<= 1) {
+            const Qt::InputMethodQuery q = Qt::InputMethodQuery(bit);
+            if (query->queries() & q)
+                query->setValue(q, queryValue(q));
+        }
+        query->accept();
+        return true;
+    }
+    case QEvent::InputMethod: {
+        // The text is left alone, so that repeated commits don't make the
+        // following queries more expensive
+        QInputMethodEvent *input = static_cast<QInputMethodEvent *>(event);
+        ++inputMethodEvents;
+        preedit = input->preeditString();
+        preeditAttributes = input->attributes().size();
+        if (!input->commitString().isEmpty()) {
+            ++commits;
+            lastCommit = input->commitString();
+        }
+        input->accept();
+        return true;
+    }
+    case QEvent::KeyPress:
+        ++keyPresses;
+        typedText += static_cast<QKeyEvent *>(event)->text();
+        event->accept();
+        return true;
+    case QEvent::KeyRelease:
+        ++keyReleases;
+        event->accept();
+        return true;
+    default:
+        return QWindow::event(event);
+    }
+}
+
+QVariant TestInputWindow::queryValue(Qt::InputMethodQuery query) const
+{
+    switch (query) {
+    case Qt::ImEnabled:
+        return true;
+    case Qt::ImSurroundingText:
+        return text;
+    case Qt::ImCursorPosition:
+        return cursorPosition;
+    case Qt::ImAnchorPosition:
+        return anchorPosition;
+    case Qt::ImCurrentSelection:
+        return text.mid(qMin(cursorPosition, anchorPosition), qAbs(cursorPosition - anchorPosition));
+    case Qt::ImHints:
+        return int(hints);
+    case Qt::ImCursorRectangle:
+        return cursorRectangle;
+    default:
+        return QVariant();
+    }
+}
+
+QMaliitPlatformInputContext *startInputContext(MockServer *server, bool sessionBus)
+{
+    if (sessionBus)
+        qunsetenv("MALIIT_SERVER_ADDRESS");
+    else
+        qputenv("MALIIT_SERVER_ADDRESS", server->address().toLocal8Bit());
+
+    // What QGuiApplication does when the focus moves
+    QScopedPointer<QMaliitPlatformInputContext> context(new QMaliitPlatformInputContext);
+    context->setFocusObject(qGuiApp->focusObject());
+    context->update(Qt::ImQueryAll);
+    // The plugin registers its object before it sends the state, so the
+    // server can call it from here on too
+    if (!spinUntil([server] { return server->hasState(); }))
+        return nullptr;
+    return context.take();
+}
@@ -0,0 +1,100 @@
+/* * This file is part of Maliit framework *
+ *
+ * Contact: maliit-discuss@lists.maliit.org
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * and appearing in the file LICENSE.LGPL included in the packaging
+ * of this file.
+ */
+
+#ifndef MALIITTEST_H
+#define MALIITTEST_H
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QGuiApplication>
+#include <QTimer>
+#include <QWindow>
+#include <QtTest/QtTest>
+
+class MockServer;
+class QMaliitPlatformInputContext;
+
+/*
+ * Focus object for the tests: answers input method queries from its
+ * members and counts what the input method sends it.
+ */
+class TestInputWindow : public QWindow
+{
+    Q_OBJECT
+
+public:
+    explicit TestInputWindow(QWindow *parent = nullptr);
+
+    // Answers to input method queries
+    QString text;
+    int cursorPosition;
+    int anchorPosition;
+    Qt::InputMethodHints hints;
+    QRect cursorRectangle;
+
+    // What the input method sent
+    int inputMethodEvents;
+    int commits;
+    QString lastCommit;
+    QString preedit;
+    int preeditAttributes;
+    int keyPresses;
+    int keyReleases;
+    QString typedText; // texts of the key presses, in order
+
+    //! Shows the window and waits until it has the focus
+    bool activate();
+
+protected:
+    bool event(QEvent *event) override;
+    virtual QVariant queryValue(Qt::InputMethodQuery query) const;
+};
+
+//! Runs the event loop until predicate() holds, without the polling delay
+//! of QTRY_VERIFY, so that it can be used inside QBENCHMARK
+template <typename Predicate>
+bool spinUntil(Predicate predicate, int timeout = 5000)
+{
+    QElapsedTimer elapsed;
+    elapsed.start();
+    // Wakes the event loop up should nothing else arrive
+    QTimer wakeUp;
+    wakeUp.start(50);
+    while (!predicate()) {
+        if (elapsed.hasExpired(timeout))
+            return false;
+        QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+    }
+    return true;
+}
+
+//! Starts a context against server the way an application gets one: it is
+//! handed the current focus object and asked to query everything. Returns
+//! it once the server has the state, null if the server never got it. The
+//! plugin finds the server through MALIIT_SERVER_ADDRESS, or on the session
+//! bus with sessionBus set.
+QMaliitPlatformInputContext *startInputContext(MockServer *server, bool sessionBus = false);
+
+//! Runs the tests without a display and without the input method the
+//! environment configures, the tests create their own input context
+#define MALIIT_TEST_MAIN(TestObject) \
+int main(int argc, char *argv[]) \
+{ \
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM")) \
+        qputenv("QT_QPA_PLATFORM", "offscreen"); \
+    qunsetenv("QT_IM_MODULE"); \
+    QGuiApplication app(argc, argv); \
+    TestObject tc; \
+    QTEST_SET_MAIN_SOURCE_PATH \
+    return QTest::qExec(&tc, argc, argv); \
+}
+
+#endif
@@ -0,0 +1,326 @@
+/* * This file is part of Maliit framework *
+ *
+ * Contact: maliit-discuss@lists.maliit.org
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * and appearing in the file LICENSE.LGPL included in the packaging
+ * of this file.
+ */
+
+#include "mockserver.h"
+
+#include "qmcontextadaptor.h"
+#include "qmsharedbuffer.h"
+
+#include <sys/mman.h>
+
+namespace
+{
+    const char * const ServerPath = "/com/meego/inputmethod/uiserver1";
+    const char * const ContextPath = "/com/meego/inputmethod/inputcontext";
+    const char * const ContextInterface = "com.meego.inputmethod.inputcontext1";
+    const char * const AddressPath = "/org/maliit/server/address";
+    const char * const ServiceName = "org.maliit.server";
+}
+
+MockUiServerObject::MockUiServerObject(MockServer *server)
+    : QObject(server) // moves along with the server
+    , m_server(server)
+{
+}
+
+void MockUiServerObject::activateContext()
+{
+    m_server->called(QStringLiteral("activateContext"));
+}
+
+void MockUiServerObject::appOrientationAboutToChange(int)
+{
+    m_server->called(QStringLiteral("appOrientationAboutToChange"));
+}
+
+void MockUiServerObject::appOrientationChanged(int)
+{
+    m_server->called(QStringLiteral("appOrientationChanged"));
+}
+
+void MockUiServerObject::hideInputMethod()
+{
+    m_server->called(QStringLiteral("hideInputMethod"));
+}
+
+void MockUiServerObject::mouseClickedOnPreedit(int, int, int, int, int, int)
+{
+    m_server->called(QStringLiteral("mouseClickedOnPreedit"));
+}
+
+void MockUiServerObject::processKeyEvent(int, int keyCode, int, const QString &, bool, int, uint, uint, uint time)
+{
+    m_server->called(QStringLiteral("processKeyEvent"));
+    m_server->processedKeys.append(qMakePair(keyCode, time));
+}
+
+void MockUiServerObject::registerAttributeExtension(int id, const QString &)
+{
+    m_server->called(QStringLiteral("registerAttributeExtension"));
+    m_server->attributeExtensions.insert(id, QVariantMap());
+}
+
+void MockUiServerObject::reset()
+{
+    m_server->called(QStringLiteral("reset"));
+    if (m_server->delaysResetReplies && message().isReplyRequired()) {
+        setDelayedReply(true);
+        m_server->m_pendingResets.append(message());
+    }
+}
+
+void MockUiServerObject::setCopyPasteState(bool, bool)
+{
+    m_server->called(QStringLiteral("setCopyPasteState"));
+}
+
+void MockUiServerObject::setExtendedAttribute(int id, const QString &target, const QString &targetItem,
+                                              const QString &attribute, const QDBusVariant &value)
+{
+    m_server->called(QStringLiteral("setExtendedAttribute"));
+    const QString name = target + QLatin1Char('/') + targetItem + QLatin1Char('/') + attribute;
+    m_server->attributeExtensions[id].insert(name, value.variant());
+}
+
+void MockUiServerObject::setPreedit(const QString &, int)
+{
+    m_server->called(QStringLiteral("setPreedit"));
+}
+
+void MockUiServerObject::showInputMethod()
+{
+    m_server->called(QStringLiteral("showInputMethod"));
+}
+
+void MockUiServerObject::unregisterAttributeExtension(int id)
+{
+    m_server->called(QStringLiteral("unregisterAttributeExtension"));
+    m_server->attributeExtensions.remove(id);
+}
+
+void MockUiServerObject::updateWidgetInformation(const QVariantMap &stateInformation, bool focusChanged)
+{
+    m_server->called(QStringLiteral("updateWidgetInformation"));
+    m_server->widgetUpdates.append(stateInformation);
+    m_server->focusChanges.append(focusChanged);
+
+    QVariantMap state = m_server->resolveSharedPayloads(stateInformation);
+    const bool delta = state.take(QStringLiteral("deltaUpdate")).toBool();
+    if (delta && m_server->mergesDeltaUpdates) {
+        for (auto it = state.constBegin(); it != state.constEnd(); ++it)
+            m_server->widgetState.insert(it.key(), it.value());
+    } else {
+        // What a stock server does, whatever the update left out is gone
+        m_server->widgetState = state;
+    }
+    if (m_server->widgetState.contains(QStringLiteral("surroundingText")))
+        m_server->m_hasState.storeRelease(true);
+}
+
+void MockUiServerObject::setSharedBuffer(uint id, const QDBusUnixFileDescriptor &buffer, uint size)
+{
+    m_server->called(QStringLiteral("setSharedBuffer"));
+    if (!m_server->acceptsSharedBuffer) {
+        sendErrorReply(QDBusError::UnknownMethod, QStringLiteral("No such method"));
+        return;
+    }
+    if (!m_server->mapSharedBuffer(id, buffer, size))
+        sendErrorReply(QDBusError::Failed, QStringLiteral("Cannot map the buffer"));
+}
+
+void MockUiServerObject::enableDeltaUpdates()
+{
+    m_server->called(QStringLiteral("enableDeltaUpdates"));
+    if (!m_server->mergesDeltaUpdates)
+        sendErrorReply(QDBusError::UnknownMethod, QStringLiteral("No such method"));
+}
+
+MockServerAddressAdaptor::MockServerAddressAdaptor(MockServer *server)
+    : QDBusAbstractAdaptor(server)
+{
+}
+
+QString MockServerAddressAdaptor::address() const
+{
+    return static_cast<MockServer *>(parent())->address();
+}
+
+MockServer::MockServer(QObject *parent)
+    : QObject(parent)
+    , acceptsSharedBuffer(false)
+    , mergesDeltaUpdates(false)
+    , releasesSharedPayloads(true)
+    , delaysResetReplies(false)
+    , sharedPayloads(0)
+    , m_server(new QDBusServer(this))
+    , m_connection(QString())
+    , m_object(this)
+    , m_sharedBufferId(0)
+    , m_sharedBuffer(nullptr)
+    , m_sharedBufferSize(0)
+{
+    qDBusRegisterMetaType<Maliit::PreeditTextFormat>();
+    qDBusRegisterMetaType<QVector<Maliit::PreeditTextFormat> >();
+    qDBusRegisterMetaType<Maliit::KeyEventRecord>();
+    qDBusRegisterMetaType<QVector<Maliit::KeyEventRecord> >();
+    new MockServerAddressAdaptor(this);
+    connect(m_server, &QDBusServer::newConnection, this, &MockServer::newConnection);
+}
+
+MockServer::~MockServer()
+{
+    disconnectClient();
+    if (QDBusConnection::sessionBus().interface()
+            && QDBusConnection::sessionBus().objectRegisteredAt(QLatin1String(AddressPath)) == this) {
+        QDBusConnection::sessionBus().unregisterObject(QLatin1String(AddressPath));
+        QDBusConnection::sessionBus().unregisterService(QLatin1String(ServiceName));
+    }
+}
+
+QString MockServer::address() const
+{
+    return m_server->address();
+}
+
+bool MockServer::publishOnSessionBus()
+{
+    QDBusConnection bus = QDBusConnection::sessionBus();
+    if (!bus.isConnected())
+        return false;
+    if (!bus.registerObject(QLatin1String(AddressPath), this, QDBusConnection::ExportAdaptors))
+        return false;
+    if (!bus.registerService(QLatin1String(ServiceName))) {
+        bus.unregisterObject(QLatin1String(AddressPath));
+        return false;
+    }
+    return true;
+}
+
+void MockServer::newConnection(const QDBusConnection &connection)
+{
+    // One client at a time, like the tests use it
+    disconnectClient();
+
+    // QDBusServer holds back the connection's messages until this returns,
+    // nothing the plugin sends right away gets lost
+    m_connection = connection;
+    m_connection.registerObject(QLatin1String(ServerPath), &m_object, QDBusConnection::ExportAllSlots);
+    emit clientConnected();
+}
+
+void MockServer::disconnectClient()
+{
+    unmapSharedBuffer();
+    if (!m_connection.isConnected())
+        return;
+    m_connection.unregisterObject(QLatin1String(ServerPath));
+    QDBusConnection::disconnectFromPeer(m_connection.name());
+    m_connection = QDBusConnection(QString());
+}
+
+void MockServer::replyToResets()
+{
+    for (const QDBusMessage &call : qAsConst(m_pendingResets))
+        m_connection.send(call.createReply());
+    m_pendingResets.clear();
+}
+
+void MockServer::called(const QString &method)
+{
+    ++m_calls[method];
+    callLog.append(method);
+}
+
+void MockServer::commitString(const QString &text)
+{
+    send(QStringLiteral("commitString"), QVariantList() << text << 0 << 0 << -1);
+}
+
+void MockServer::updatePreedit(const QString &text, const QVector<Maliit::PreeditTextFormat> &formats,
+                               int cursorPos)
+{
+    send(QStringLiteral("updatePreedit"),
+         QVariantList() << text << QVariant::fromValue(formats) << 0 << 0 << cursorPos);
+}
+
+void MockServer::keyEvent(int type, int key, const QString &text)
+{
+    send(QStringLiteral("keyEvent"),
+         QVariantList() << type << key << 0 << text << false << 1
+                        << QVariant::fromValue(uchar(Maliit::EventRequestEventOnly)));
+}
+
+void MockServer::keyEvents(const QVector<Maliit::KeyEventRecord> &events)
+{
+    send(QStringLiteral("keyEvents"), QVariantList() << QVariant::fromValue(events));
+}
+
+QDBusPendingCall MockServer::asyncCall(const QString &method, const QVariantList &arguments)
+{
+    QDBusMessage message = QDBusMessage::createMethodCall(QString(), QLatin1String(ContextPath),
+                                                          QLatin1String(ContextInterface), method);
+    message.setArguments(arguments);
+    return m_connection.asyncCall(message);
+}
+
+void MockServer::send(const QString &method, const QVariantList &arguments)
+{
+    QDBusMessage message = QDBusMessage::createMethodCall(QString(), QLatin1String(ContextPath),
+                                                          QLatin1String(ContextInterface), method);
+    message.setArguments(arguments);
+    m_connection.send(message);
+}
+
+bool MockServer::mapSharedBuffer(uint id, const QDBusUnixFileDescriptor &buffer, uint size)
+{
+    unmapSharedBuffer();
+    void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, buffer.fileDescriptor(), 0);
+    if (data == MAP_FAILED)
+        return false;
+    m_sharedBufferId = id;
+    m_sharedBuffer = static_cast<uchar *>(data);
+    m_sharedBufferSize = size;
+    return true;
+}
+
+void MockServer::unmapSharedBuffer()
+{
+    if (m_sharedBuffer)
+        munmap(m_sharedBuffer, m_sharedBufferSize);
+    m_sharedBuffer = nullptr;
+    m_sharedBufferSize = 0;
+}
+
+QVariantMap MockServer::resolveSharedPayloads(const QVariantMap &state)
+{
+    auto it = state.constFind(QStringLiteral("surroundingTextShm"));
+    if (it == state.constEnd())
+        return state;
+
+    // [buffer id, offset, length in bytes, end position] of UTF-16 text
+    const QVariantList payload = qdbus_cast<QVariantList>(it.value());
+    QVariantMap result(state);
+    result.remove(it.key());
+    if (payload.size() < 4 || !m_sharedBuffer || payload.at(0).toUInt() != m_sharedBufferId)
+        return result;
+
+    const uint offset = payload.at(1).toUInt();
+    const uint length = payload.at(2).toUInt();
+    if (offset + length > m_sharedBufferSize)
+        return result;
+
+    result.insert(QStringLiteral("surroundingText"),
+                  QString(reinterpret_cast<const QChar *>(m_sharedBuffer + offset), int(length / sizeof(QChar))));
+    ++sharedPayloads;
+    if (releasesSharedPayloads)
+        QMaliitSharedBuffer::release(m_sharedBuffer, payload.at(3).toULongLong());
+    return result;
+}
@@ -0,0 +1,153 @@
+/* * This file is part of Maliit framework *
+ *
+ * Contact: maliit-discuss@lists.maliit.org
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * and appearing in the file LICENSE.LGPL included in the packaging
+ * of this file.
+ */
+
+#ifndef MOCKSERVER_H
+#define MOCKSERVER_H
+
+#include "qmnamespace.h"
+
+#include <QHash>
+#include <QObject>
+#include <QVariant>
+#include <QtDBus/QtDBus>
+
+class MockServer;
+
+// Registered at /com/meego/inputmethod/uiserver1 on the client's connection
+class MockUiServerObject : public QObject, protected QDBusContext
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "com.meego.inputmethod.uiserver1")
+
+public:
+    explicit MockUiServerObject(MockServer *server);
+
+public Q_SLOTS:
+    void activateContext();
+    void appOrientationAboutToChange(int angle);
+    void appOrientationChanged(int angle);
+    void hideInputMethod();
+    void mouseClickedOnPreedit(int posX, int posY, int preeditRectX, int preeditRectY,
+                               int preeditRectWidth, int preeditRectHeight);
+    void processKeyEvent(int keyType, int keyCode, int modifiers, const QString &text, bool autoRepeat,
+                         int count, uint nativeScanCode, uint nativeModifiers, uint time);
+    void registerAttributeExtension(int id, const QString &fileName);
+    void reset();
+    void setCopyPasteState(bool copyAvailable, bool pasteAvailable);
+    void setExtendedAttribute(int id, const QString &target, const QString &targetItem,
+                              const QString &attribute, const QDBusVariant &value);
+    void setPreedit(const QString &text, int cursorPos);
+    void showInputMethod();
+    void unregisterAttributeExtension(int id);
+    void updateWidgetInformation(const QVariantMap &stateInformation, bool focusChanged);
+    // Extensions the plugin negotiates, see MockServer's capability flags
+    void setSharedBuffer(uint id, const QDBusUnixFileDescriptor &buffer, uint size);
+    void enableDeltaUpdates();
+
+private:
+    MockServer *m_server;
+};
+
+// org.maliit.Server.Address, for looking the mock up on the session bus
+class MockServerAddressAdaptor : public QDBusAbstractAdaptor
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.maliit.Server.Address")
+    Q_PROPERTY(QString address READ address)
+
+public:
+    explicit MockServerAddressAdaptor(MockServer *server);
+
+    QString address() const;
+};
+
+/*
+ * Peer-to-peer stand-in for the Maliit server. Point the plugin at it with
+ * MALIIT_SERVER_ADDRESS, or publish it on the session bus in place of
+ * org.maliit.server. Calls from the plugin are handled as the event loop
+ * of the server's thread runs, benchmarks move it to a thread of its own.
+ *
+ * Like a stock server it neither takes a shared buffer nor merges delta
+ * updates, the capability flags turn those on.
+ */
+class MockServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit MockServer(QObject *parent = nullptr);
+    ~MockServer();
+
+    QString address() const;
+    bool isConnected() const { return m_connection.isConnected(); }
+    //! Whether the plugin sent its surrounding text, safe from any thread
+    bool hasState() const { return m_hasState.loadAcquire(); }
+
+    //! Registers as org.maliit.server on the session bus, false if there is
+    //! no session bus or another server already runs
+    bool publishOnSessionBus();
+
+    // Capabilities, all off like a stock server
+    bool acceptsSharedBuffer;
+    bool mergesDeltaUpdates;
+    // Off, the server never copies shared payloads out and the ring fills
+    bool releasesSharedPayloads;
+    // Holds back replies to awaited reset() calls until replyToResets()
+    bool delaysResetReplies;
+
+    // What the plugin sent
+    int callCount(const QString &method) const { return m_calls.value(method); }
+    QStringList callLog; // methods in the order they were called
+    QVariantMap widgetState; // as the server keeps it, shared payloads resolved
+    QList<QVariantMap> widgetUpdates; // updateWidgetInformation maps as received
+    QList<bool> focusChanges; // focusChanged of each update
+    int sharedPayloads; // surrounding texts that came through the shared buffer
+    QHash<int, QVariantMap> attributeExtensions; // attributes by extension id
+    QList<QPair<int, uint> > processedKeys; // key and time of each processKeyEvent
+
+    // Calls into the plugin's com.meego.inputmethod.inputcontext1
+    void commitString(const QString &text);
+    void updatePreedit(const QString &text, const QVector<Maliit::PreeditTextFormat> &formats, int cursorPos);
+    void keyEvent(int type, int key, const QString &text);
+    void keyEvents(const QVector<Maliit::KeyEventRecord> &events);
+    QDBusPendingCall asyncCall(const QString &method, const QVariantList &arguments = QVariantList());
+    void send(const QString &method, const QVariantList &arguments = QVariantList());
+
+    //! Drops the plugin's connection as a crashing server would
+    void disconnectClient();
+
+    //! Answers the reset() calls held back by delaysResetReplies
+    void replyToResets();
+
+Q_SIGNALS:
+    void clientConnected();
+
+private:
+    friend class MockUiServerObject;
+
+    void newConnection(const QDBusConnection &connection);
+    void called(const QString &method);
+    bool mapSharedBuffer(uint id, const QDBusUnixFileDescriptor &buffer, uint size);
+    void unmapSharedBuffer();
+    QVariantMap resolveSharedPayloads(const QVariantMap &state);
+
+    QDBusServer *m_server;
+    QDBusConnection m_connection;
+    MockUiServerObject m_object;
+    QHash<QString, int> m_calls;
+    QAtomicInt m_hasState;
+    QList<QDBusMessage> m_pendingResets;
+    uint m_sharedBufferId;
+    uchar *m_sharedBuffer;
+    uint m_sharedBufferSize;
+};
+
+#endif